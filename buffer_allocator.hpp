@@ -0,0 +1,244 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <atomic>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+
+namespace fft
+{
+    /**
+     * @brief 大きなバッファに使うページの種類
+     * @note None: 通常の4KBページ
+     * @note Transparent: mmapで確保し、madvise(MADV_HUGEPAGE)でTransparent Huge Pageを要求する
+     * @note Explicit: MAP_HUGETLBで予約済みのHuge Pageから確保する. 確保できなければTransparentに落とす
+     * @note Linux以外ではどの設定でもNoneと同じ.
+     */
+    enum class HugePageMode
+    {
+        None,
+        Transparent,
+        Explicit,
+    };
+
+    inline std::atomic<HugePageMode> huge_page_mode{HugePageMode::None};
+
+    /*この大きさ以上のバッファでだけHuge Pageを使う(2MB)*/
+    inline constexpr std::size_t huge_page_size = std::size_t(1) << 21;
+
+    inline void set_huge_page_mode(HugePageMode mode)
+    {
+        huge_page_mode.store(mode, std::memory_order_relaxed);
+    }
+
+    inline HugePageMode get_huge_page_mode()
+    {
+        return huge_page_mode.load(std::memory_order_relaxed);
+    }
+
+    namespace detail
+    {
+        /**
+         * @brief 返すポインタの直前(Alignmentバイト)に置く管理情報
+         * @note 確保後にHugePageModeが変わっても、確保した方法で解放できるようにする.
+         */
+        struct BufferHeader
+        {
+            void* base;         // 確保した領域の先頭
+            std::size_t length; // 確保した領域の長さ
+            bool is_mapped;     // mmapで確保したか
+        };
+
+        inline void* allocate_buffer(std::size_t bytes, std::size_t alignment)
+        {
+            std::size_t total = bytes + alignment; // 先頭のalignmentバイトに管理情報を置く
+            void* base = nullptr;
+            std::size_t length = total;
+            bool is_mapped = false;
+
+#if defined(__linux__)
+            HugePageMode mode = get_huge_page_mode();
+            if (mode != HugePageMode::None && total >= huge_page_size)
+            {
+                length = (total + huge_page_size - 1) / huge_page_size * huge_page_size;
+#if defined(MAP_HUGETLB)
+                if (mode == HugePageMode::Explicit)
+                {
+                    void* ptr = ::mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+                    if (ptr != MAP_FAILED)
+                    {
+                        base = ptr;
+                        is_mapped = true;
+                    }
+                }
+#endif
+                if (!base)
+                {
+                    // THPは2MB境界にそろっていないと効かないので、余分に確保して先頭を切り詰める
+                    std::size_t mapped_length = length + huge_page_size;
+                    void* ptr = ::mmap(nullptr, mapped_length, PROT_READ | PROT_WRITE,
+                                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                    if (ptr != MAP_FAILED)
+                    {
+                        std::uintptr_t addr = reinterpret_cast<std::uintptr_t>(ptr);
+                        std::uintptr_t aligned = (addr + huge_page_size - 1) / huge_page_size * huge_page_size;
+                        std::size_t head = aligned - addr;
+                        if (head > 0)
+                            ::munmap(ptr, head);
+                        std::size_t tail = mapped_length - head - length;
+                        if (tail > 0)
+                            ::munmap(reinterpret_cast<void*>(aligned + length), tail);
+#if defined(MADV_HUGEPAGE)
+                        ::madvise(reinterpret_cast<void*>(aligned), length, MADV_HUGEPAGE);
+#endif
+                        base = reinterpret_cast<void*>(aligned);
+                        is_mapped = true;
+                    }
+                }
+            }
+#endif
+            if (!base)
+            {
+                base = ::operator new(total, std::align_val_t(alignment));
+                length = total;
+            }
+
+            auto* header = static_cast<BufferHeader*>(base);
+            header->base = base;
+            header->length = length;
+            header->is_mapped = is_mapped;
+            return static_cast<char*>(base) + alignment;
+        }
+
+        inline void deallocate_buffer(void* ptr, std::size_t alignment) noexcept
+        {
+            auto* header = reinterpret_cast<BufferHeader*>(static_cast<char*>(ptr) - alignment);
+            void* base = header->base;
+#if defined(__linux__)
+            if (header->is_mapped)
+            {
+                ::munmap(base, header->length);
+                return;
+            }
+#endif
+            ::operator delete(base, std::align_val_t(alignment));
+        }
+    }
+
+    /**
+     * @brief 変換用バッファのアロケータ
+     * @note 先頭をAlignment(既定64byte = キャッシュライン, AVX-512の1レジスタ)境界にそろえる.
+     * @note HugePageModeがNone以外なら、2MB以上のバッファはHuge Pageで確保してTLBミスを減らす.
+     */
+    template <class T, std::size_t Alignment = 64>
+    class BufferAllocator
+    {
+        static_assert(Alignment >= alignof(T), "Alignment must satisfy alignof(T)");
+        static_assert(Alignment >= sizeof(detail::BufferHeader), "Alignment must hold the buffer header");
+        static_assert((Alignment & (Alignment - 1)) == 0, "Alignment must be a power of two");
+
+    public:
+        using value_type = T;
+
+        template <class U>
+        struct rebind
+        {
+            using other = BufferAllocator<U, Alignment>;
+        };
+
+        BufferAllocator() noexcept = default;
+
+        template <class U>
+        BufferAllocator(const BufferAllocator<U, Alignment>&) noexcept {}
+
+        T* allocate(std::size_t n)
+        {
+            return static_cast<T*>(detail::allocate_buffer(n * sizeof(T), Alignment));
+        }
+
+        void deallocate(T* ptr, std::size_t) noexcept
+        {
+            detail::deallocate_buffer(ptr, Alignment);
+        }
+    };
+
+    template <class T, class U, std::size_t Alignment>
+    bool operator==(const BufferAllocator<T, Alignment>&, const BufferAllocator<U, Alignment>&) noexcept
+    {
+        return true;
+    }
+
+    template <class T, class U, std::size_t Alignment>
+    bool operator!=(const BufferAllocator<T, Alignment>&, const BufferAllocator<U, Alignment>&) noexcept
+    {
+        return false;
+    }
+
+    /**
+     * @brief 確保時に値を書き込まないアロケータ(ファーストタッチ用)
+     * @note 引数なしのconstructは、トリビアルにコピー・破棄できる型(double, std::complex<double>など)では何もしない.
+     *       std::vector::resize(n)でゼロ埋めされないので、ページは最初に書き込んだスレッドのNUMAノードに割り当てられる.
+     * @note その代わり、resize直後の値は不定. 確保したスレッドとは別のスレッドが必ず先に書き込むバッファにだけ使う.
+     */
+    template <class T, std::size_t Alignment = 64>
+    class FirstTouchAllocator : public BufferAllocator<T, Alignment>
+    {
+    public:
+        using value_type = T;
+
+        template <class U>
+        struct rebind
+        {
+            using other = FirstTouchAllocator<U, Alignment>;
+        };
+
+        FirstTouchAllocator() noexcept = default;
+
+        template <class U>
+        FirstTouchAllocator(const FirstTouchAllocator<U, Alignment>&) noexcept {}
+
+        template <class U>
+        void construct(U* ptr) noexcept(std::is_nothrow_default_constructible_v<U>)
+        {
+            if constexpr (!(std::is_trivially_copyable_v<U> && std::is_trivially_destructible_v<U>))
+            {
+                ::new (static_cast<void*>(ptr)) U();
+            }
+        }
+
+        template <class U, class... Args>
+        void construct(U* ptr, Args&&... args)
+        {
+            ::new (static_cast<void*>(ptr)) U(std::forward<Args>(args)...);
+        }
+    };
+
+    template <class T, class U, std::size_t Alignment>
+    bool operator==(const FirstTouchAllocator<T, Alignment>&, const FirstTouchAllocator<U, Alignment>&) noexcept
+    {
+        return true;
+    }
+
+    template <class T, class U, std::size_t Alignment>
+    bool operator!=(const FirstTouchAllocator<T, Alignment>&, const FirstTouchAllocator<U, Alignment>&) noexcept
+    {
+        return false;
+    }
+
+    /*変換で使うバッファの型*/
+    template <class T>
+    using BufferVector = std::vector<T, BufferAllocator<T>>;
+
+    /*スレッドごとに分担して最初に書き込むバッファの型(2次元変換の係数・転置など)*/
+    template <class T>
+    using FirstTouchVector = std::vector<T, FirstTouchAllocator<T>>;
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+#include "fft_policy.hpp"
+
+#include <complex>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <span>
+#include <cmath>
+
+
+/**
+ * @brief チャープZ変換(ズームFFT)
+ * @note 任意の帯域に等間隔に並んだM個の周波数点を、O((N+M)log(N+M))で計算する.
+ *       X_m = 1/N * Σ_n{x(n) * exp{+j*2*pi*f_m*n/N}}, f_m = first_bin + m*bin_step (n=0,...N-1)
+ * @note 周波数の単位は入力長Nのビン. f_mが整数でNが2のべき乗なら、Fourier::fourier_coef()[f_m]と一致する.
+ * @note Bluesteinの恒等式 m*n = {m^2 + n^2 - (m-n)^2}/2 で、長さL(>= N+M-1の2のべき乗)の巡回畳み込みに直す.
+ *       チャープとそのスペクトルは構築時に一度だけ計算する.
+ */
+template <class FftPolicy>
+class ChirpZ
+{
+    using FourierCoef = std::complex<double>;
+    using FourierVector = typename FftPolicy::FourierVector;
+    using RotorVector = typename FftPolicy::RotorVector;
+
+    size_t size_;       // 入力長N
+    size_t num_points_; // 出力点数M
+    size_t fft_size_;   // 畳み込みの長さL
+    double first_bin_;
+    double bin_step_;
+
+    /**
+     * @brief 長さLの変換の回転子と作業領域
+     */
+    RotorVector rotors_;
+    typename FftPolicy::Workspace workspace_;
+
+    /**
+     * @brief 入力に掛けるチャープ exp{j*2*pi*(first_bin*n + bin_step*n^2/2)/N} / N
+     */
+    FourierVector pre_chirp_;
+
+    /**
+     * @brief 出力に掛けるチャープ exp{j*2*pi*bin_step*m^2/2/N}
+     */
+    FourierVector post_chirp_;
+
+    /**
+     * @brief 畳み込み核 exp{-j*2*pi*bin_step*j^2/2/N} のスペクトル(L倍化済み)
+     */
+    FourierVector chirp_spectrum_;
+
+    /**
+     * @brief 畳み込みの作業領域(長さL)
+     */
+    FourierVector buffer_;
+
+    std::shared_ptr<fft::ThreadPool> pool_;
+
+    /**
+     * @brief exp{j*2*pi*bin*n/N}の位相
+     * @note n^2が大きくなっても精度が落ちないように、long doubleで2*piの倍数を除いてから角度にする.
+     */
+    double phase(long double bin, long double n) const
+    {
+        long double cycles = std::fmod(bin * n, (long double)size_);
+        return (double)(2.0L * 3.141592653589793238L * cycles / size_);
+    }
+
+public:
+    /**
+     * @brief Construct a new Chirp Z object
+     *
+     * @param size 入力長N(2のべき乗でなくてよい)
+     * @param num_points 出力する周波数点の数M
+     * @param first_bin 最初の周波数点(ビン単位, 小数可)
+     * @param bin_step 周波数点の間隔(ビン単位, 小数可)
+     * @param pool 内部のFFTを並列化するスレッドプール
+     */
+    ChirpZ(size_t size,
+           size_t num_points,
+           double first_bin,
+           double bin_step,
+           std::shared_ptr<fft::ThreadPool> pool = nullptr)
+        : size_(size)
+        , num_points_(num_points)
+        , fft_size_(FftPolicy::calc_size(size + num_points - 1))
+        , first_bin_(first_bin)
+        , bin_step_(bin_step)
+        , rotors_(FftPolicy::calc_rotors(fft_size_))
+        , workspace_(FftPolicy::make_workspace(fft_size_))
+        , pool_(std::move(pool))
+    {
+        pre_chirp_.resize(size_);
+        for (size_t n = 0; n < size_; ++n)
+        {
+            double theta = phase(first_bin_, n) + phase(0.5L * bin_step_ * n, n);
+            pre_chirp_[n] = std::polar(1.0 / size_, theta);
+        }
+
+        post_chirp_.resize(num_points_);
+        for (size_t m = 0; m < num_points_; ++m)
+        {
+            post_chirp_[m] = std::polar(1.0, phase(0.5L * bin_step_ * m, m));
+        }
+
+        // 核b(j) = exp{-j*theta*j^2/2}は j = -(N-1),...,M-1 を使う. 負の添字は末尾に折り返す.
+        chirp_spectrum_.assign(fft_size_, FourierCoef(0.0, 0.0));
+        for (size_t j = 0; j < num_points_; ++j)
+        {
+            chirp_spectrum_[j] = std::polar(1.0, -phase(0.5L * bin_step_ * j, j));
+        }
+        for (size_t j = 1; j < size_; ++j)
+        {
+            chirp_spectrum_[fft_size_ - j] = std::polar(1.0, -phase(0.5L * bin_step_ * j, j));
+        }
+        FftPolicy::fft(chirp_spectrum_.data(), fft_size_, rotors_, workspace_, pool_.get());
+        for (auto& c : chirp_spectrum_)
+        {
+            c *= (double)fft_size_; // fftの1/NをここでLに戻しておく
+        }
+
+        buffer_.resize(fft_size_);
+    }
+
+    virtual ~ChirpZ() {};
+    ChirpZ(const ChirpZ&) = default;
+    ChirpZ& operator=(const ChirpZ&) = default;
+    ChirpZ(ChirpZ&&) = default;
+    ChirpZ& operator=(ChirpZ&&) = default;
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    size_t num_points() const
+    {
+        return num_points_;
+    }
+
+    /**
+     * @brief m番目の出力の周波数(ビン単位)
+     */
+    double frequency_bin(size_t m) const
+    {
+        return first_bin_ + m * bin_step_;
+    }
+
+    /**
+     * @brief チャープZ変換
+     * @note ヒープ確保は行わない.
+     *
+     * @param data 入力. size()より短ければ残りをゼロとして扱い、長ければ先頭size()個だけを使う
+     * @param size dataの長さ
+     * @param out 長さnum_points()以上の出力
+     * @return true
+     * @return false outが短い
+     */
+    template <class T>
+    bool transform(const T* data, size_t size, std::span<FourierCoef> out)
+    {
+        if (out.size() < num_points_)
+            return false;
+
+        size_t n = std::min(size, size_);
+        for (size_t i = 0; i < n; ++i)
+        {
+            buffer_[i] = pre_chirp_[i] * (double)data[i];
+        }
+        std::fill(std::begin(buffer_) + n, std::end(buffer_), FourierCoef(0.0, 0.0));
+
+        FftPolicy::fft(buffer_.data(), fft_size_, rotors_, workspace_, pool_.get(), n);
+        for (size_t k = 0; k < fft_size_; ++k)
+        {
+            buffer_[k] *= chirp_spectrum_[k];
+        }
+        FftPolicy::ifft(buffer_.data(), fft_size_, rotors_, workspace_, pool_.get());
+
+        for (size_t m = 0; m < num_points_; ++m)
+        {
+            out[m] = post_chirp_[m] * buffer_[m];
+        }
+        return true;
+    }
+
+    template <class T>
+    std::vector<FourierCoef> transform(const T* data, size_t size)
+    {
+        std::vector<FourierCoef> out(num_points_);
+        transform(data, size, std::span<FourierCoef>(out));
+        return out;
+    }
+};
@@ -0,0 +1,433 @@
+#pragma once
+
+#include "fourier.hpp"
+
+#include <complex>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <span>
+#include <cmath>
+#include <limits>
+
+
+/**
+ * @brief ブロックごとの畳み込みの方式
+ */
+enum class ConvolutionMethod
+{
+    OverlapSave, // 直近のN点を変換し、巡回畳み込みの後半(線形畳み込みと一致する部分)を出力する
+    OverlapAdd,  // 新しいブロックだけをゼロ埋めして変換し、はみ出した分を次のブロックに足す
+};
+
+
+/**
+ * @brief FFTによる長い畳み込み y(n) = Σ_m{h(m) * x(n-m)}
+ * @note フィルタのスペクトルは構築時に一度だけ計算する. 変換は実数FFT(N/2点の複素FFT).
+ * @note ブロック長Bを指定しなければ、タップ数Mに対して1出力あたりの計算量
+ *       {2 * (N/2) * log2(N/2) * 5 + N * 3} / (N - M + 1) が最小になるN(2のべき乗)を選び、B = N - M + 1 とする.
+ * @note processはBサンプルずつのストリーミング(遅れなし). 作業領域は構築時に確保し、ブロックごとにはヒープを確保しない.
+ * @note convolveは信号全体の畳み込み. 出力ブロックごとに独立なオーバーラップ・セーブで、ブロックをスレッドに分配する.
+ */
+template <class FftPolicy>
+class Convolver
+{
+    using FourierCoef = std::complex<double>;
+    using FourierVector = typename FftPolicy::FourierVector;
+    using DataVector = fft::BufferVector<double>;
+
+    Fourier<FftPolicy> fourier_;
+
+    size_t taps_;       // M
+    size_t block_size_; // B
+    ConvolutionMethod method_;
+
+    /**
+     * @brief フィルタのスペクトル(ビン0...N/2). 巡回畳み込みのN倍を含む
+     */
+    FourierVector filter_;
+
+    /**
+     * @brief ストリーミングの状態と作業領域
+     */
+    DataVector frame_;       // OverlapSave: 直近N個の入力. OverlapAdd: 新しいブロック
+    DataVector result_;      // 巡回畳み込み
+    DataVector tail_;        // OverlapAdd: 次のブロックに足すM-1個
+    FourierVector spectrum_; // ビン0...N/2
+
+    /**
+     * @brief 長さsize(N以下)のframeを変換してフィルタを掛け、resultに戻す
+     */
+    void filter_frame(const double* frame, size_t size, FourierCoef* spectrum, double* result, fft::ThreadPool* pool) const
+    {
+        const size_t half = fourier_.size() / 2 + 1;
+        std::span<FourierCoef> bins(spectrum, half);
+        fourier_.rfft(frame, size, bins, pool);
+        for (size_t k = 0; k < half; ++k) { spectrum[k] *= filter_[k]; }
+        fourier_.irfft(bins, result, fourier_.size(), pool);
+    }
+
+public:
+    /**
+     * @brief タップ数Mに対して1出力あたりの計算量が最小になるFFTの長さ
+     */
+    static size_t optimal_fft_size(size_t taps)
+    {
+        size_t best = FftPolicy::calc_size(2 * std::max<size_t>(1, taps));
+        double best_cost = std::numeric_limits<double>::max();
+        for (size_t n = best; n <= (size_t(1) << 24); n *= 2)
+        {
+            double half = 0.5 * n;
+            double cost = (10.0 * half * std::log2(std::max(half, 1.0)) + 3.0 * n) / (double)(n - taps + 1);
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                best = n;
+            }
+        }
+        return best;
+    }
+
+    /**
+     * @brief Construct a new Convolver object
+     *
+     * @param filter フィルタのタップ h(0)...h(M-1)
+     * @param taps M. 1以上
+     * @param block_size 1回のprocessで受け取るサンプル数B. 0ならコストモデルで決める
+     * @param method ストリーミングの方式
+     * @param pool 変換とconvolveのブロックを並列化するスレッドプール
+     */
+    template <class T>
+    Convolver(const T* filter,
+              size_t taps,
+              size_t block_size = 0,
+              ConvolutionMethod method = ConvolutionMethod::OverlapSave,
+              std::shared_ptr<fft::ThreadPool> pool = nullptr)
+        : fourier_(block_size > 0 ? FftPolicy::calc_size(block_size + std::max<size_t>(1, taps) - 1)
+                                  : optimal_fft_size(taps),
+                   std::move(pool))
+        , taps_(std::max<size_t>(1, taps))
+        , method_(method)
+    {
+        const size_t n = fourier_.size();
+        block_size_ = block_size > 0 ? block_size : n - taps_ + 1;
+
+        fourier_.prepare_real();
+        filter_.resize(n / 2 + 1);
+        spectrum_.resize(n / 2 + 1);
+        frame_.assign(n, 0.0);
+        result_.resize(n);
+        tail_.assign(taps_ - 1, 0.0);
+
+        // 係数は1/N化されているので、巡回畳み込みのスペクトルは N * X_k * H_k
+        if (taps > 0)
+            fourier_.rfft(filter, taps, std::span<FourierCoef>(filter_.data(), filter_.size()));
+        else
+            std::fill(std::begin(filter_), std::end(filter_), FourierCoef(0.0, 0.0));
+        for (auto& value : filter_) { value *= (double)n; }
+    }
+
+    virtual ~Convolver() {};
+    Convolver(const Convolver&) = default;
+    Convolver& operator=(const Convolver&) = default;
+    Convolver(Convolver&&) = default;
+    Convolver& operator=(Convolver&&) = default;
+
+    size_t taps() const
+    {
+        return taps_;
+    }
+
+    size_t block_size() const
+    {
+        return block_size_;
+    }
+
+    size_t fft_size() const
+    {
+        return fourier_.size();
+    }
+
+    ConvolutionMethod method() const
+    {
+        return method_;
+    }
+
+    /**
+     * @brief 過去の入力を消す(無音から始める)
+     */
+    void reset()
+    {
+        std::fill(std::begin(frame_), std::end(frame_), 0.0);
+        std::fill(std::begin(tail_), std::end(tail_), 0.0);
+    }
+
+    /**
+     * @brief 1ブロック分の畳み込み(ストリーミング)
+     * @note 出力は遅れない. 前のブロックの入力の影響はOverlapSaveでは保存した入力から、
+     *       OverlapAddでは保存したはみ出し分から加わる.
+     *
+     * @param in block_size()個の新しいサンプル
+     * @param out block_size()個の出力先
+     */
+    template <class T, class U>
+    bool process(const T* in, U* out)
+    {
+        const size_t n = fourier_.size();
+        const size_t b = block_size_;
+        fft::ThreadPool* pool = fourier_.thread_pool().get();
+
+        if (method_ == ConvolutionMethod::OverlapSave)
+        {
+            // 直近N-B個を前に寄せ、新しいB個を後ろに置く. 巡回畳み込みの添字M-1以上は線形畳み込みと一致する
+            const size_t keep = n - b;
+            std::copy(std::begin(frame_) + b, std::end(frame_), std::begin(frame_));
+            for (size_t i = 0; i < b; ++i) { frame_[keep + i] = (double)in[i]; }
+            filter_frame(frame_.data(), n, spectrum_.data(), result_.data(), pool);
+            for (size_t i = 0; i < b; ++i) { out[i] = (U)result_[keep + i]; }
+            return true;
+        }
+
+        // OverlapAdd: 長さB+M-1 <= Nの線形畳み込みを求め、前のブロックのはみ出しを足す
+        for (size_t i = 0; i < b; ++i) { frame_[i] = (double)in[i]; }
+        filter_frame(frame_.data(), b, spectrum_.data(), result_.data(), pool);
+        const size_t overlap = taps_ - 1;
+        for (size_t i = 0; i < b; ++i)
+        {
+            out[i] = (U)(result_[i] + (i < overlap ? tail_[i] : 0.0));
+        }
+        for (size_t j = 0; j < overlap; ++j)
+        {
+            tail_[j] = result_[b + j] + (b + j < overlap ? tail_[b + j] : 0.0);
+        }
+        return true;
+    }
+
+    /**
+     * @brief 信号全体の線形畳み込み(オフライン)
+     * @note 出力ブロック[i*B, (i+1)*B)は入力[i*B-(M-1), (i+1)*B)だけから決まるので、ブロックごとに独立に計算できる.
+     *       スレッドごとに作業領域を確保し、ブロックを分配する. ストリーミングの状態は使わない.
+     * @note BはN - M + 1(FFTの長さで扱える最大のブロック).
+     *
+     * @param in
+     * @param size
+     * @param out 長さsize + M - 1以上の出力先
+     */
+    template <class T>
+    bool convolve(const T* in, size_t size, std::span<double> out) const
+    {
+        if (size == 0)
+            return true;
+        const size_t length = size + taps_ - 1;
+        if (out.size() < length)
+            return false;
+
+        const size_t n = fourier_.size();
+        const size_t overlap = taps_ - 1;
+        const size_t b = n - overlap;
+        const size_t num_blocks = (length + b - 1) / b;
+        fft::ThreadPool* pool = fourier_.thread_pool().get();
+
+        auto run = [&](size_t first, size_t last, fft::ThreadPool* inner) {
+            DataVector frame(n);
+            DataVector result(n);
+            FourierVector spectrum(n / 2 + 1);
+            for (size_t i = first; i < last; ++i)
+            {
+                // frame(t) = x(i*B - (M-1) + t), t = 0...B+M-2 (範囲外はゼロ)
+                const long origin = (long)(i * b) - (long)overlap;
+                for (size_t t = 0; t < n; ++t)
+                {
+                    long index = origin + (long)t;
+                    frame[t] = index >= 0 && index < (long)size ? (double)in[index] : 0.0;
+                }
+                filter_frame(frame.data(), n, spectrum.data(), result.data(), inner);
+
+                const size_t count = std::min(b, length - i * b);
+                std::copy(std::begin(result) + overlap, std::begin(result) + overlap + count, std::begin(out) + i * b);
+            }
+        };
+
+        if (pool && num_blocks >= pool->size())
+        {
+            // スレッドごとに作業領域を1つ確保し、連続したブロックをまとめて受け持つ
+            const size_t chunks = pool->size();
+            pool->parallel_for(0, chunks, 1, [&](size_t first, size_t last) {
+                for (size_t c = first; c < last; ++c)
+                {
+                    run(num_blocks * c / chunks, num_blocks * (c + 1) / chunks, nullptr);
+                }
+            });
+        }
+        else
+        {
+            run(0, num_blocks, pool);
+        }
+        return true;
+    }
+};
+
+
+/**
+ * @brief 一様分割による低遅延の畳み込み(非常に長いフィルタ向け)
+ * @note フィルタをブロック長Bごとに P = ceil(M/B) 個に分け、それぞれのスペクトル H_p を構築時に求める.
+ *       入力は直近2Bサンプル(N = calc_size(2B)点)のスペクトル X_i を周波数領域の遅延線(FDL)に積み、
+ *       Y = Σ_p{X_{i-p} * H_p} を1回の逆変換で時間領域に戻して、後半Bサンプルを出力する(オーバーラップ・セーブ).
+ * @note 遅延はブロック長Bだけで、1ブロックあたりの変換は順・逆1回ずつ. 積和はP * (N/2+1)回.
+ * @note 作業領域とFDLは構築時に確保し、ブロックごとにはヒープを確保しない.
+ */
+template <class FftPolicy>
+class PartitionedConvolver
+{
+    using FourierCoef = std::complex<double>;
+    using FourierVector = typename FftPolicy::FourierVector;
+    using DataVector = fft::BufferVector<double>;
+
+    Fourier<FftPolicy> fourier_;
+
+    size_t taps_;       // M
+    size_t block_size_; // B
+    size_t partitions_; // P
+    size_t bins_;       // N/2+1
+
+    /**
+     * @brief 分割したフィルタのスペクトル[P][N/2+1]. 巡回畳み込みのN倍を含む
+     */
+    FourierVector filters_;
+
+    /**
+     * @brief 周波数領域の遅延線[P][N/2+1](リングバッファ)
+     * @note head_が最新の入力スペクトル. head_ + pがpブロック前.
+     */
+    FourierVector delay_line_;
+    size_t head_;
+
+    /**
+     * @brief 作業領域
+     */
+    DataVector frame_;       // 直近N個の入力
+    DataVector result_;
+    FourierVector accumulator_;
+
+public:
+    /**
+     * @brief Construct a new Partitioned Convolver object
+     *
+     * @param filter フィルタのタップ h(0)...h(M-1)
+     * @param taps M. 1以上
+     * @param block_size ブロック長B(遅延). 1以上
+     * @param pool 変換と積和を並列化するスレッドプール
+     */
+    template <class T>
+    PartitionedConvolver(const T* filter,
+                         size_t taps,
+                         size_t block_size,
+                         std::shared_ptr<fft::ThreadPool> pool = nullptr)
+        : fourier_(FftPolicy::calc_size(2 * std::max<size_t>(1, block_size)), std::move(pool))
+        , taps_(std::max<size_t>(1, taps))
+        , block_size_(std::max<size_t>(1, block_size))
+        , head_(0)
+    {
+        const size_t n = fourier_.size();
+        partitions_ = (taps_ + block_size_ - 1) / block_size_;
+        bins_ = n / 2 + 1;
+
+        fourier_.prepare_real();
+        filters_.resize(partitions_ * bins_);
+        delay_line_.assign(partitions_ * bins_, FourierCoef(0.0, 0.0));
+        frame_.assign(n, 0.0);
+        result_.resize(n);
+        accumulator_.resize(bins_);
+
+        // 区間ごとに変換する. 係数は1/N化されているので、巡回畳み込みのスペクトルは N * X_k * H_k
+        DataVector part(block_size_);
+        for (size_t p = 0; p < partitions_; ++p)
+        {
+            size_t offset = p * block_size_;
+            size_t count = std::min(block_size_, taps > offset ? taps - offset : 0);
+            for (size_t i = 0; i < count; ++i) { part[i] = (double)filter[offset + i]; }
+            std::span<FourierCoef> spectrum(filters_.data() + p * bins_, bins_);
+            fourier_.rfft(part.data(), count, spectrum);
+            for (auto& value : spectrum) { value *= (double)n; }
+        }
+    }
+
+    virtual ~PartitionedConvolver() {};
+    PartitionedConvolver(const PartitionedConvolver&) = default;
+    PartitionedConvolver& operator=(const PartitionedConvolver&) = default;
+    PartitionedConvolver(PartitionedConvolver&&) = default;
+    PartitionedConvolver& operator=(PartitionedConvolver&&) = default;
+
+    size_t taps() const
+    {
+        return taps_;
+    }
+
+    size_t block_size() const
+    {
+        return block_size_;
+    }
+
+    size_t partitions() const
+    {
+        return partitions_;
+    }
+
+    size_t fft_size() const
+    {
+        return fourier_.size();
+    }
+
+    /**
+     * @brief 過去の入力を消す(無音から始める)
+     */
+    void reset()
+    {
+        std::fill(std::begin(frame_), std::end(frame_), 0.0);
+        std::fill(std::begin(delay_line_), std::end(delay_line_), FourierCoef(0.0, 0.0));
+        head_ = 0;
+    }
+
+    /**
+     * @brief 1ブロック分の畳み込み
+     *
+     * @param in block_size()個の新しいサンプル
+     * @param out block_size()個の出力先(同じブロックの入力までの畳み込み)
+     */
+    template <class T, class U>
+    bool process(const T* in, U* out)
+    {
+        const size_t n = fourier_.size();
+        const size_t b = block_size_;
+        const size_t keep = n - b;
+        fft::ThreadPool* pool = fourier_.thread_pool().get();
+
+        // 1. 直近N個の入力を変換してFDLの先頭に積む(最も古いスペクトルを上書きする)
+        std::copy(std::begin(frame_) + b, std::end(frame_), std::begin(frame_));
+        for (size_t i = 0; i < b; ++i) { frame_[keep + i] = (double)in[i]; }
+        head_ = head_ == 0 ? partitions_ - 1 : head_ - 1;
+        std::span<FourierCoef> latest(delay_line_.data() + head_ * bins_, bins_);
+        fourier_.rfft(frame_.data(), n, latest, pool);
+
+        // 2. Y_k = Σ_p{X_{i-p},k * H_p,k}. ビンの区間をスレッドに分配する
+        auto accumulate = [&](size_t first, size_t last) {
+            std::fill(std::begin(accumulator_) + first, std::begin(accumulator_) + last, FourierCoef(0.0, 0.0));
+            for (size_t p = 0; p < partitions_; ++p)
+            {
+                size_t slot = head_ + p < partitions_ ? head_ + p : head_ + p - partitions_;
+                const FourierCoef* x = delay_line_.data() + slot * bins_;
+                const FourierCoef* h = filters_.data() + p * bins_;
+                for (size_t k = first; k < last; ++k) { accumulator_[k] += x[k] * h[k]; }
+            }
+        };
+        if (pool && partitions_ * bins_ >= FftPolicy::parallel_grain)
+            pool->parallel_for(0, bins_, std::max<size_t>(1, FftPolicy::parallel_grain / partitions_), accumulate);
+        else
+            accumulate(0, bins_);
+
+        // 3. 逆変換の後半Bサンプル(添字N-B >= B-1なので線形畳み込みと一致する)
+        fourier_.irfft(std::span<FourierCoef>(accumulator_.data(), bins_), result_.data(), n, pool);
+        for (size_t i = 0; i < b; ++i) { out[i] = (U)result_[keep + i]; }
+        return true;
+    }
+};
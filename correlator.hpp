@@ -0,0 +1,298 @@
+#pragma once
+
+#include "fourier.hpp"
+
+#include <complex>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <span>
+#include <cmath>
+
+
+/**
+ * @brief 相関の正規化
+ */
+enum class CorrelationScale
+{
+    None,        // Σ_n{x(n+l) * r(n)}
+    Biased,      // 1/S倍(Sは信号の長さ)
+    Unbiased,    // ラグlで重なる項の数で割る
+    Coefficient, // sqrt{Σx^2 * Σr^2}で割る(相関係数. 自己相関ではラグ0が1)
+};
+
+
+/**
+ * @brief 参照信号と多数の信号の相互相関 c(l) = Σ_n{x(n+l) * r(n)}
+ * @note 参照信号のスペクトルの共役 N * conj(R_k) を構築時に一度だけ計算する.
+ *       信号ごとの計算は実数FFT、積、逆実数FFTの1往復だけ(C_k = N * X_k * conj(R_k)).
+ * @note 出力はラグ -(R-1)...S-1 の S+R-1 個(Rは参照、Sは信号の長さ). out[i]がラグ i-(R-1).
+ *       xが参照をdサンプル遅らせたものなら、ラグdで最大になる.
+ * @note 自己相関はパワースペクトル N * |X_k|^2 の逆変換で求める.
+ */
+template <class FftPolicy>
+class Correlator
+{
+    using FourierCoef = std::complex<double>;
+    using FourierVector = typename FftPolicy::FourierVector;
+    using DataVector = fft::BufferVector<double>;
+
+    Fourier<FftPolicy> fourier_;
+
+    size_t reference_size_; // R
+    size_t max_size_;       // Sの上限
+    double reference_energy_;
+
+    /**
+     * @brief 参照信号のスペクトルの共役(ビン0...N/2). 巡回相関のN倍を含む
+     */
+    FourierVector reference_;
+
+    /**
+     * @brief 作業領域
+     */
+    FourierVector spectrum_;
+    DataVector result_;
+
+    template <class T>
+    static double energy(const T* data, size_t size)
+    {
+        double sum = 0.0;
+        for (size_t i = 0; i < size; ++i) { sum += (double)data[i] * (double)data[i]; }
+        return sum;
+    }
+
+    /**
+     * @brief 1本の信号の相互相関(作業領域は呼び出し元が用意する)
+     */
+    template <class T>
+    void xcorr_core(const T* signal, size_t size, CorrelationScale scale,
+                    FourierCoef* spectrum, double* result, double* out, fft::ThreadPool* pool) const
+    {
+        const size_t n = fourier_.size();
+        const size_t bins = n / 2 + 1;
+        std::span<FourierCoef> half(spectrum, bins);
+        fourier_.rfft(signal, size, half, pool);
+        for (size_t k = 0; k < bins; ++k) { spectrum[k] *= reference_[k]; }
+        fourier_.irfft(half, result, n, pool);
+
+        // 巡回相関の負のラグは後ろに回っている
+        const size_t r = reference_size_;
+        const size_t length = size + r - 1;
+        double norm = 1.0;
+        if (scale == CorrelationScale::Biased)
+            norm = size > 0 ? 1.0 / size : 1.0;
+        else if (scale == CorrelationScale::Coefficient)
+        {
+            double e = std::sqrt(energy(signal, size) * reference_energy_);
+            norm = e > 0.0 ? 1.0 / e : 1.0;
+        }
+        for (size_t i = 0; i < length; ++i)
+        {
+            long lag = (long)i - (long)(r - 1);
+            double value = result[lag >= 0 ? (size_t)lag : n - (size_t)(-lag)];
+            if (scale == CorrelationScale::Unbiased)
+            {
+                // ラグlで重なる項は n = max(0, -l)...min(R, S-l)-1
+                long overlap = std::min((long)r, (long)size - lag) - std::max(0L, -lag);
+                value /= (double)std::max(1L, overlap);
+            }
+            out[i] = value * norm;
+        }
+    }
+
+public:
+    /**
+     * @brief Construct a new Correlator object
+     *
+     * @param reference 参照信号 r(0)...r(R-1)
+     * @param reference_size R. 1以上
+     * @param max_size 相関をとる信号の長さSの上限(自己相関も同じ上限)
+     * @param pool 変換とバッチ処理を並列化するスレッドプール
+     */
+    template <class T>
+    Correlator(const T* reference,
+               size_t reference_size,
+               size_t max_size,
+               std::shared_ptr<fft::ThreadPool> pool = nullptr)
+        : fourier_(FftPolicy::calc_size(std::max(std::max<size_t>(1, reference_size) + max_size - 1, 2 * max_size)),
+                   std::move(pool))
+        , reference_size_(std::max<size_t>(1, reference_size))
+        , max_size_(max_size)
+    {
+        const size_t n = fourier_.size();
+        const size_t bins = n / 2 + 1;
+        fourier_.prepare_real();
+        reference_.resize(bins);
+        spectrum_.resize(bins);
+        result_.resize(n);
+
+        fourier_.rfft(reference, reference_size, std::span<FourierCoef>(reference_.data(), bins));
+        for (auto& value : reference_) { value = std::conj(value) * (double)n; }
+        reference_energy_ = energy(reference, reference_size);
+    }
+
+    virtual ~Correlator() {};
+    Correlator(const Correlator&) = default;
+    Correlator& operator=(const Correlator&) = default;
+    Correlator(Correlator&&) = default;
+    Correlator& operator=(Correlator&&) = default;
+
+    size_t reference_size() const
+    {
+        return reference_size_;
+    }
+
+    size_t max_size() const
+    {
+        return max_size_;
+    }
+
+    size_t fft_size() const
+    {
+        return fourier_.size();
+    }
+
+    /*長さsizeの信号との相互相関の出力の長さ*/
+    size_t output_size(size_t size) const
+    {
+        return size + reference_size_ - 1;
+    }
+
+    /**
+     * @brief 参照信号との相互相関
+     *
+     * @param signal
+     * @param size max_size()以下
+     * @param out 長さoutput_size(size)以上の出力先. out[i]がラグ i-(R-1)
+     * @param scale 正規化
+     */
+    template <class T>
+    bool xcorr(const T* signal, size_t size, std::span<double> out, CorrelationScale scale = CorrelationScale::None)
+    {
+        if (size > max_size_ || out.size() < output_size(size))
+            return false;
+
+        xcorr_core(signal, size, scale, spectrum_.data(), result_.data(), out.data(), fourier_.thread_pool().get());
+        return true;
+    }
+
+    /**
+     * @brief 連続して並んだcount本の長さsizeの信号と参照信号の相互相関
+     * @note 本数がスレッド数以上なら1本ずつスレッドに割り当てる(スレッドごとの作業領域を確保する).
+     *       少なければ1本ずつ、変換の中で並列化する.
+     *
+     * @param signals count * size個
+     * @param size max_size()以下
+     * @param count
+     * @param out 長さcount * output_size(size)以上. i本目の結果はout[i * output_size(size)]から
+     * @param scale 正規化
+     */
+    template <class T>
+    bool xcorr_batch(const T* signals, size_t size, size_t count, std::span<double> out,
+                     CorrelationScale scale = CorrelationScale::None)
+    {
+        const size_t length = output_size(size);
+        if (size > max_size_ || out.size() < length * count)
+            return false;
+
+        fft::ThreadPool* pool = fourier_.thread_pool().get();
+        if (pool && count >= pool->size())
+        {
+            const size_t n = fourier_.size();
+            const size_t chunks = pool->size();
+            pool->parallel_for(0, chunks, 1, [&](size_t first, size_t last) {
+                FourierVector spectrum(n / 2 + 1);
+                DataVector result(n);
+                for (size_t c = first; c < last; ++c)
+                {
+                    for (size_t i = count * c / chunks; i < count * (c + 1) / chunks; ++i)
+                    {
+                        xcorr_core(signals + i * size, size, scale, spectrum.data(), result.data(),
+                                   out.data() + i * length, nullptr);
+                    }
+                }
+            });
+        }
+        else
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                xcorr_core(signals + i * size, size, scale, spectrum_.data(), result_.data(),
+                           out.data() + i * length, pool);
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief 自己相関 a(l) = Σ_n{x(n+l) * x(n)} (l = 0...S-1. 負のラグは a(-l) = a(l))
+     * @note パワースペクトル N * |X_k|^2 を逆変換する. 参照信号は使わない.
+     *
+     * @param signal
+     * @param size max_size()以下
+     * @param out 長さsize以上の出力先. out[l]がラグl
+     * @param scale 正規化(Coefficientならa(0) = 1)
+     */
+    template <class T>
+    bool autocorrelation(const T* signal, size_t size, std::span<double> out,
+                         CorrelationScale scale = CorrelationScale::None)
+    {
+        if (size > max_size_ || out.size() < size)
+            return false;
+        if (size == 0)
+            return true;
+
+        const size_t n = fourier_.size();
+        const size_t bins = n / 2 + 1;
+        fft::ThreadPool* pool = fourier_.thread_pool().get();
+        std::span<FourierCoef> half(spectrum_.data(), bins);
+        fourier_.rfft(signal, size, half, pool);
+        for (size_t k = 0; k < bins; ++k)
+        {
+            spectrum_[k] = FourierCoef(n * std::norm(spectrum_[k]), 0.0);
+        }
+        fourier_.irfft(half, result_.data(), size, pool);
+
+        double norm = 1.0;
+        if (scale == CorrelationScale::Biased)
+            norm = 1.0 / size;
+        else if (scale == CorrelationScale::Coefficient)
+            norm = result_[0] > 0.0 ? 1.0 / result_[0] : 1.0;
+        for (size_t l = 0; l < size; ++l)
+        {
+            double value = result_[l] * norm;
+            if (scale == CorrelationScale::Unbiased)
+                value /= (double)(size - l);
+            out[l] = value;
+        }
+        return true;
+    }
+
+    /**
+     * @brief 相互相関が最大になるラグ
+     * @note 最大値の前後3点に放物線を当てはめて、サンプル間の位置まで求める.
+     *
+     * @param corr xcorrの出力(長さoutput_size(S))
+     * @param interpolate 放物線補間するか
+     * @return ラグ(信号が参照より遅れているサンプル数). corrが空なら0
+     */
+    double peak_lag(std::span<const double> corr, bool interpolate = true) const
+    {
+        if (corr.empty())
+            return 0.0;
+
+        size_t i = std::max_element(std::begin(corr), std::end(corr)) - std::begin(corr);
+        double offset = 0.0;
+        if (interpolate && i > 0 && i + 1 < corr.size())
+        {
+            double y0 = corr[i - 1];
+            double y1 = corr[i];
+            double y2 = corr[i + 1];
+            double denom = y0 - 2.0 * y1 + y2;
+            if (denom < 0.0)
+                offset = 0.5 * (y0 - y2) / denom;
+        }
+        return (double)i - (double)(reference_size_ - 1) + offset;
+    }
+};
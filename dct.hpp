@@ -0,0 +1,341 @@
+#pragma once
+
+#include "fft_policy.hpp"
+
+#include <complex>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <span>
+#include <cmath>
+
+
+/**
+ * @brief FFTで計算する直交DCT-II/DCT-III
+ * @note DCT-II:  X_k = s_k * Σ_n{x(n) * cos{pi*(2n+1)*k/(2N)}},  s_0 = sqrt(1/N), s_k = sqrt(2/N)
+ * @note DCT-III: x(n) = Σ_k{s_k * X_k * cos{pi*(2n+1)*k/(2N)}}  (DCT-IIの逆変換)
+ * @note Makhoulの方法: 偶数番目を前から、奇数番目を後ろから並べた実数列vのN点DFTに、
+ *       exp{+j*pi*k/(2N)}を掛けた実部がDCT-IIになる. vのN点実数DFTはN/2点の複素FFTで求める.
+ *       鏡像を作って2N点の複素FFTを行う場合に比べて演算量は1/4.
+ * @note 前後の回転 exp{+j*pi*m/(2N)} の表は1つだけ持ち、実数DFTの分離で使う exp{+j*2*pi*k/N} はその4つおきを参照する.
+ * @note 変換はdouble, floatのバッファの上でその場で行い、変換中にヒープは確保しない.
+ */
+template <class FftPolicy>
+class CosineTransform
+{
+    using FourierCoef = std::complex<double>;
+    using FourierVector = typename FftPolicy::FourierVector;
+
+    size_t size_;      // N(2のべき乗)
+    size_t half_size_; // N/2(複素FFTの点数)
+
+    /**
+     * @brief 回転子の表 exp{+j*pi*m/(2N)} (m = 0...2N)
+     */
+    FourierVector twiddles_;
+
+    /**
+     * @brief N/2点FFTの回転子と作業領域
+     */
+    typename FftPolicy::RotorVector rotors_;
+    typename FftPolicy::Workspace workspace_;
+
+    /**
+     * @brief 1回の変換の作業領域(長さN/2). 並列に使う場合は呼び出し元が用意する
+     */
+    FourierVector scratch_;
+
+    std::shared_ptr<fft::ThreadPool> pool_;
+
+    /*並べ替えた列vのi番目が元の列の何番目か*/
+    size_t source_index(size_t i) const
+    {
+        return i < half_size_ ? 2 * i : 2 * (size_ - 1 - i) + 1;
+    }
+
+public:
+    /**
+     * @brief Construct a new Cosine Transform object
+     *
+     * @param size 変換長. 2のべき乗に切り上げられる(変換するバッファはsize()の長さにすること)
+     * @param pool 内部のFFTを並列化するスレッドプール
+     */
+    CosineTransform(size_t size, std::shared_ptr<fft::ThreadPool> pool = nullptr)
+        : pool_(std::move(pool))
+    {
+        size_ = FftPolicy::calc_size(size);
+        half_size_ = std::max<size_t>(1, size_ / 2);
+
+        twiddles_.resize(2 * size_ + 1);
+        double base = 3.141592653589793 / (2 * size_);
+        for (size_t m = 0; m < twiddles_.size(); ++m)
+        {
+            twiddles_[m] = std::polar(1.0, base * m);
+        }
+
+        rotors_ = FftPolicy::calc_rotors(half_size_);
+        workspace_ = FftPolicy::make_workspace(half_size_);
+        scratch_.resize(half_size_);
+    }
+
+    virtual ~CosineTransform() {};
+    CosineTransform(const CosineTransform&) = default;
+    CosineTransform& operator=(const CosineTransform&) = default;
+    CosineTransform(CosineTransform&&) = default;
+    CosineTransform& operator=(CosineTransform&&) = default;
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    /**
+     * @brief DCT-II(その場で変換)
+     * @param data 長さsize()のdoubleまたはfloatの配列
+     * @param size size()と同じであること
+     */
+    template <class T>
+    bool dct2(T* data, size_t size)
+    {
+        if (size != size_)
+            return false;
+        dct2(data, scratch_.data(), pool_.get());
+        return true;
+    }
+
+    /**
+     * @brief DCT-III(DCT-IIの逆変換, その場で変換)
+     */
+    template <class T>
+    bool dct3(T* data, size_t size)
+    {
+        if (size != size_)
+            return false;
+        dct3(data, scratch_.data(), pool_.get());
+        return true;
+    }
+
+    /**
+     * @brief 作業領域を指定するDCT-II(複数のスレッドから同時に呼べる)
+     * @param scratch 長さsize()/2以上(size() == 1のときは1)の作業領域
+     */
+    template <class T>
+    void dct2(T* data, FourierCoef* scratch, fft::ThreadPool* pool = nullptr) const
+    {
+        const size_t n = size_;
+        const size_t m = half_size_;
+        if (n == 1)
+            return; // X_0 = x_0
+
+        // 1. v(i) = x(2i), v(N-1-i) = x(2i+1) を z(k) = v(2k) + j*v(2k+1) に詰める
+        for (size_t k = 0; k < m; ++k)
+        {
+            scratch[k] = FourierCoef(data[source_index(2 * k)], data[source_index(2 * k + 1)]);
+        }
+
+        // 2. N/2点の複素FFT(1/(N/2)化)
+        FftPolicy::fft(scratch, m, rotors_, workspace_, pool);
+
+        // 3. 実数DFTに分離して後ろの回転を掛ける
+        //    E_k = (Z_k + conj(Z_{m-k}))/2, O_k = (Z_k - conj(Z_{m-k}))/(2j)
+        //    V_k = (E_k + exp{+j*2*pi*k/N} * O_k)/2, a_k = exp{+j*pi*k/(2N)} * V_k
+        //    X_k = N * Re(a_k), X_{N-k} = N * Im(a_k)
+        const double s0 = std::sqrt(1.0 / n) * n;
+        const double s1 = std::sqrt(2.0 / n) * n;
+        for (size_t k = 0; k <= m; ++k)
+        {
+            FourierCoef za = scratch[k % m];
+            FourierCoef zb = std::conj(scratch[(m - k) % m]);
+            FourierCoef e = (za + zb) * 0.5;
+            FourierCoef o = (za - zb) * FourierCoef(0.0, -0.5);
+            FourierCoef a = twiddles_[k] * (e + twiddles_[4 * k] * o) * 0.5;
+            if (k == 0)
+            {
+                data[0] = (T)(a.real() * s0);
+            }
+            else
+            {
+                data[k] = (T)(a.real() * s1);
+                if (k < m)
+                    data[n - k] = (T)(a.imag() * s1);
+            }
+        }
+    }
+
+    /**
+     * @brief 作業領域を指定するDCT-III(複数のスレッドから同時に呼べる)
+     */
+    template <class T>
+    void dct3(T* data, FourierCoef* scratch, fft::ThreadPool* pool = nullptr) const
+    {
+        const size_t n = size_;
+        const size_t m = half_size_;
+        if (n == 1)
+            return;
+
+        // 1. dct2の3.を逆にたどる
+        //    a_k = (X_k + j*X_{N-k})/N (X_N = 0), V_k = exp{-j*pi*k/(2N)} * a_k, V_{k+m} = conj(V_{m-k})
+        //    E_k = V_k + V_{k+m}, O_k = exp{-j*2*pi*k/N} * (V_k - V_{k+m}), Z_k = E_k + j*O_k
+        const double s0 = 1.0 / (std::sqrt(1.0 / n) * n);
+        const double s1 = 1.0 / (std::sqrt(2.0 / n) * n);
+        auto spectrum = [&](size_t k) -> FourierCoef {
+            FourierCoef a;
+            if (k == 0)
+                a = FourierCoef(data[0] * s0, 0.0);
+            else if (k == m)
+                a = FourierCoef(data[m] * s1, data[m] * s1);
+            else
+                a = FourierCoef(data[k] * s1, data[n - k] * s1);
+            return std::conj(twiddles_[k]) * a;
+        };
+        for (size_t k = 0; k < m; ++k)
+        {
+            FourierCoef va = spectrum(k);
+            FourierCoef vb = std::conj(spectrum(m - k));
+            FourierCoef e = va + vb;
+            FourierCoef o = std::conj(twiddles_[4 * k]) * (va - vb);
+            scratch[k] = e + FourierCoef(0.0, 1.0) * o;
+        }
+
+        // 2. N/2点の逆FFT
+        FftPolicy::ifft(scratch, m, rotors_, workspace_, pool);
+
+        // 3. 並べ替えを戻す
+        for (size_t k = 0; k < m; ++k)
+        {
+            data[source_index(2 * k)] = (T)scratch[k].real();
+            data[source_index(2 * k + 1)] = (T)scratch[k].imag();
+        }
+    }
+};
+
+
+/**
+ * @brief 2次元の直交DCT-II/DCT-III
+ * @note 行ごと、列ごとに1次元のDCTを行う(分離可能). データは[height][width]の行優先.
+ * @note 幅と高さが同じなら行と列で回転子の表を共有する.
+ * @note 行・列はスレッドプールのスレッド数に分けて並列に変換し、作業領域はスレッドごとに構築時に確保する.
+ */
+template <class FftPolicy>
+class CosineTransform2D
+{
+    using FourierCoef = std::complex<double>;
+    using FourierVector = typename FftPolicy::FourierVector;
+    using Transform = CosineTransform<FftPolicy>;
+
+    std::shared_ptr<const Transform> rows_;    // 行方向(長さwidth)
+    std::shared_ptr<const Transform> columns_; // 列方向(長さheight)
+
+    /**
+     * @brief スレッドごとの作業領域
+     */
+    std::vector<FourierVector> scratches_;
+    std::vector<std::vector<double>> columns_buffer_;
+
+    std::shared_ptr<fft::ThreadPool> pool_;
+
+    template <class Func>
+    void dispatch(size_t count, Func&& func)
+    {
+        size_t n_chunks = scratches_.size();
+        auto chunk = [&](size_t first, size_t last) {
+            for (size_t c = first; c < last; ++c)
+            {
+                func(c, count * c / n_chunks, count * (c + 1) / n_chunks);
+            }
+        };
+        if (pool_)
+            pool_->parallel_for(0, n_chunks, 1, chunk);
+        else
+            chunk(0, n_chunks);
+    }
+
+    template <bool Inverse, class T>
+    void transform(T* data)
+    {
+        size_t width = rows_->size();
+        size_t height = columns_->size();
+
+        dispatch(height, [&](size_t c, size_t first, size_t last) {
+            for (size_t y = first; y < last; ++y)
+            {
+                if constexpr (Inverse)
+                    rows_->dct3(data + y * width, scratches_[c].data());
+                else
+                    rows_->dct2(data + y * width, scratches_[c].data());
+            }
+        });
+
+        dispatch(width, [&](size_t c, size_t first, size_t last) {
+            auto& column = columns_buffer_[c];
+            for (size_t x = first; x < last; ++x)
+            {
+                for (size_t y = 0; y < height; ++y) { column[y] = data[y * width + x]; }
+                if constexpr (Inverse)
+                    columns_->dct3(column.data(), scratches_[c].data());
+                else
+                    columns_->dct2(column.data(), scratches_[c].data());
+                for (size_t y = 0; y < height; ++y) { data[y * width + x] = (T)column[y]; }
+            }
+        });
+    }
+
+public:
+    CosineTransform2D(size_t width, size_t height, std::shared_ptr<fft::ThreadPool> pool = nullptr)
+        : pool_(std::move(pool))
+    {
+        rows_ = std::make_shared<const Transform>(width);
+        columns_ = (FftPolicy::calc_size(height) == rows_->size()) ? rows_ : std::make_shared<const Transform>(height);
+
+        size_t n_threads = pool_ ? pool_->size() : 1;
+        size_t scratch_size = std::max<size_t>(1, std::max(rows_->size(), columns_->size()) / 2);
+        scratches_.resize(n_threads);
+        columns_buffer_.resize(n_threads);
+        for (size_t i = 0; i < n_threads; ++i)
+        {
+            scratches_[i].resize(scratch_size);
+            columns_buffer_[i].resize(columns_->size());
+        }
+    }
+
+    virtual ~CosineTransform2D() {};
+    CosineTransform2D(const CosineTransform2D&) = default;
+    CosineTransform2D& operator=(const CosineTransform2D&) = default;
+    CosineTransform2D(CosineTransform2D&&) = default;
+    CosineTransform2D& operator=(CosineTransform2D&&) = default;
+
+    size_t width() const
+    {
+        return rows_->size();
+    }
+
+    size_t height() const
+    {
+        return columns_->size();
+    }
+
+    /**
+     * @brief 2次元DCT-II(その場で変換)
+     * @param data [height()][width()]のdoubleまたはfloatの配列
+     */
+    template <class T>
+    bool dct2_2d(T* data, size_t width, size_t height)
+    {
+        if (width != rows_->size() || height != columns_->size())
+            return false;
+        transform<false>(data);
+        return true;
+    }
+
+    /**
+     * @brief 2次元DCT-III(2次元DCT-IIの逆変換, その場で変換)
+     */
+    template <class T>
+    bool dct3_2d(T* data, size_t width, size_t height)
+    {
+        if (width != rows_->size() || height != columns_->size())
+            return false;
+        transform<true>(data);
+        return true;
+    }
+};
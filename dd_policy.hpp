@@ -0,0 +1,429 @@
+#pragma once
+
+#include "fft_policy.hpp"
+
+#include <cmath>
+#include <complex>
+#include <vector>
+#include <algorithm>
+#include <span>
+#include <utility>
+
+
+namespace fft
+{
+    /**
+     * @brief double-double(倍々精度)の実数 hi + lo
+     * @note |lo| <= ulp(hi)/2. 仮数部は約106bit(相対誤差 約1e-32).
+     * @note 加算・乗算は誤差のない変換(two_sum, two_prod)で丸め誤差を下位に拾う.
+     */
+    struct DDReal
+    {
+        double hi = 0.0;
+        double lo = 0.0;
+
+        DDReal() = default;
+        constexpr DDReal(double h) : hi(h), lo(0.0) {}
+        constexpr DDReal(double h, double l) : hi(h), lo(l) {}
+
+        /*a + b = s + e (|a| >= |b|)*/
+        static DDReal fast_two_sum(double a, double b)
+        {
+            double s = a + b;
+            return DDReal(s, b - (s - a));
+        }
+
+        /*a + b = s + e*/
+        static DDReal two_sum(double a, double b)
+        {
+            double s = a + b;
+            double bb = s - a;
+            return DDReal(s, (a - (s - bb)) + (b - bb));
+        }
+
+        /*a * b = p + e (fmaで誤差を厳密に求める)*/
+        static DDReal two_prod(double a, double b)
+        {
+            double p = a * b;
+            return DDReal(p, std::fma(a, b, -p));
+        }
+
+        friend DDReal operator+(const DDReal& a, const DDReal& b)
+        {
+            DDReal s = two_sum(a.hi, b.hi);
+            DDReal t = two_sum(a.lo, b.lo);
+            s.lo += t.hi;
+            s = fast_two_sum(s.hi, s.lo);
+            s.lo += t.lo;
+            return fast_two_sum(s.hi, s.lo);
+        }
+
+        friend DDReal operator-(const DDReal& a)
+        {
+            return DDReal(-a.hi, -a.lo);
+        }
+
+        friend DDReal operator-(const DDReal& a, const DDReal& b)
+        {
+            return a + (-b);
+        }
+
+        friend DDReal operator*(const DDReal& a, const DDReal& b)
+        {
+            DDReal p = two_prod(a.hi, b.hi);
+            p.lo += a.hi * b.lo + a.lo * b.hi;
+            return fast_two_sum(p.hi, p.lo);
+        }
+
+        friend DDReal operator*(const DDReal& a, double b)
+        {
+            DDReal p = two_prod(a.hi, b);
+            p.lo += a.lo * b;
+            return fast_two_sum(p.hi, p.lo);
+        }
+
+        friend DDReal operator/(const DDReal& a, double b)
+        {
+            double q1 = a.hi / b;
+            DDReal p = two_prod(q1, b);
+            DDReal r = two_sum(a.hi, -p.hi); // a - q1 * b
+            r.lo += a.lo - p.lo;
+            double q2 = (r.hi + r.lo) / b;
+            return fast_two_sum(q1, q2);
+        }
+
+        /*2のべき乗倍は誤差なく計算できる*/
+        DDReal scaled(double power_of_two) const
+        {
+            return DDReal(hi * power_of_two, lo * power_of_two);
+        }
+
+        double to_double() const
+        {
+            return hi + lo;
+        }
+    };
+
+    /**
+     * @brief double-doubleの複素数
+     */
+    struct DDComplex
+    {
+        DDReal re;
+        DDReal im;
+
+        DDComplex() = default;
+        DDComplex(const DDReal& r, const DDReal& i) : re(r), im(i) {}
+        DDComplex(const std::complex<double>& c) : re(c.real()), im(c.imag()) {}
+
+        friend DDComplex operator+(const DDComplex& a, const DDComplex& b)
+        {
+            return DDComplex(a.re + b.re, a.im + b.im);
+        }
+
+        friend DDComplex operator-(const DDComplex& a, const DDComplex& b)
+        {
+            return DDComplex(a.re - b.re, a.im - b.im);
+        }
+
+        friend DDComplex operator*(const DDComplex& a, const DDComplex& b)
+        {
+            return DDComplex(a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re);
+        }
+
+        friend DDComplex conj(const DDComplex& a)
+        {
+            return DDComplex(a.re, -a.im);
+        }
+
+        DDComplex scaled(double power_of_two) const
+        {
+            return DDComplex(re.scaled(power_of_two), im.scaled(power_of_two));
+        }
+
+        std::complex<double> to_complex() const
+        {
+            return std::complex<double>(re.to_double(), im.to_double());
+        }
+    };
+
+    /**
+     * @brief double-double精度のFFTポリシー(検証用の基準)
+     * @note CooleyTurkeyと同じ周波数間引き型のバタフライ・ビットリバースの作業領域・規約
+     *       (W_k = exp{+j*2*pi*k/N}, 順変換で1/N化)で、演算をすべてdouble-doubleで行う.
+     * @note 回転子はdouble-doubleのπから、8分円の対称性で[0, π/4]に落としてTaylor級数で作る.
+     *       丸め誤差は約1e-32 * log2(N)で、doubleのポリシーの誤差(約1e-16 * log2(N))を測るのに十分小さい.
+     * @note 計算量はO(N log N)なので、O(N^2)のdftの代わりにN = 2^24程度まで基準として使える.
+     */
+    class DoubleDouble
+    {
+        /*π/2 = pi_2_hi + pi_2_lo*/
+        static constexpr double pi_2_hi = 1.5707963267948966;
+        static constexpr double pi_2_lo = 6.123233995736766e-17;
+
+        /**
+         * @brief [0, π/4]のxに対するsin(x), cos(x)のTaylor級数
+         */
+        static void sin_cos(const DDReal& x, DDReal& s, DDReal& c)
+        {
+            DDReal term = x; // x^n/n!
+            s = x;
+            c = DDReal(1.0);
+            for (int n = 2; n < 40; n += 2)
+            {
+                // cos: (-1)^(n/2) * x^n/n!, sin: (-1)^(n/2) * x^(n+1)/(n+1)!
+                term = term * x / n;
+                c = c + ((n % 4 == 2) ? -term : term);
+                term = term * x / (n + 1);
+                s = s + ((n % 4 == 2) ? -term : term);
+                if (std::abs(term.hi) < 1e-35)
+                    break;
+            }
+        }
+
+        template <bool Inverse>
+        static DDComplex rotor(const DDComplex* rotors, size_t index)
+        {
+            if constexpr (Inverse)
+                return conj(rotors[index]);
+            else
+                return rotors[index];
+        }
+
+        /**
+         * @brief 1レベル分のバタフライ演算のうち、通し番号[first, last)の区間を計算する
+         * @note 引数と入力の枝刈りはCooleyTurkey::butterflyと同じ.
+         */
+        template <bool Inverse>
+        static void butterfly(DDComplex* fouriers,
+                              const DDComplex* rotors,
+                              size_t half_size,
+                              size_t butterfly_num,
+                              size_t first,
+                              size_t last,
+                              size_t extent)
+        {
+            size_t nonzero = std::min(extent, 2 * half_size);
+            size_t full_end = nonzero > half_size ? nonzero - half_size : 0;
+            size_t half_end = std::min(nonzero, half_size);
+
+            size_t j = first / half_size;
+            size_t k = first % half_size;
+            for (size_t b = first; b < last; ++j, k = 0)
+            {
+                size_t butterfly_offset = 2 * half_size * j;
+                size_t k_end = std::min(half_size, k + (last - b));
+                b += k_end - k;
+                for (; k < std::min(k_end, full_end); ++k)
+                {
+                    size_t j1 = butterfly_offset + k;
+                    size_t j2 = j1 + half_size;
+                    auto f1 = fouriers[j1];
+                    auto f2 = fouriers[j2];
+                    fouriers[j1] = f1 + f2;
+                    fouriers[j2] = rotor<Inverse>(rotors, k * butterfly_num) * (f1 - f2);
+                }
+                for (; k < std::min(k_end, half_end); ++k)
+                {
+                    size_t j1 = butterfly_offset + k;
+                    fouriers[j1 + half_size] = rotor<Inverse>(rotors, k * butterfly_num) * fouriers[j1];
+                }
+                k = k_end;
+            }
+        }
+
+        template <class Func>
+        static void dispatch(ThreadPool* pool, size_t begin, size_t end, Func&& func)
+        {
+            if (pool)
+                pool->parallel_for(begin, end, parallel_grain, std::forward<Func>(func));
+            else
+                func(begin, end);
+        }
+
+    public:
+        /*1要素あたりの演算がdoubleの約10倍なので、CooleyTurkeyより細かく分割する*/
+        static constexpr size_t parallel_grain = CooleyTurkey::parallel_grain / 8;
+        static constexpr size_t full_extent = CooleyTurkey::full_extent;
+
+        using FourierVector = BufferVector<DDComplex>;
+        using RotorVector = BufferVector<DDComplex>;
+        using Workspace = CooleyTurkey::Workspace;
+
+        static size_t calc_size(size_t size)
+        {
+            return CooleyTurkey::calc_size(size);
+        }
+
+        /**
+         * @brief W_k = exp{+j*2*pi*k/N} をdouble-double精度で計算する
+         * @note Nは2のべき乗なので、k/N と 4k/N の小数部は誤差なく求まる.
+         */
+        static DDComplex calc_rotor(size_t k, size_t size)
+        {
+            double t = 4.0 * (double)(k % size) / (double)size; // 単位は四分円
+            int quadrant = (int)t;
+            double r = t - quadrant;                             // [0, 1)
+            bool swap = r > 0.5;                                 // π/4を超えたら余角で計算する
+            if (swap)
+                r = 1.0 - r;
+
+            DDReal x = DDReal(pi_2_hi, pi_2_lo) * r;
+            DDReal s, c;
+            sin_cos(x, s, c);
+            if (swap)
+                std::swap(s, c);
+
+            switch (quadrant)
+            {
+            case 1:
+                return DDComplex(-s, c);
+            case 2:
+                return DDComplex(-c, -s);
+            case 3:
+                return DDComplex(s, -c);
+            default:
+                return DDComplex(c, s);
+            }
+        }
+
+        /**
+         * @brief 回転子 W_k (k = 0...N/2-1)
+         * @note バタフライで参照するのは前半だけ.
+         */
+        static RotorVector calc_rotors(size_t size, ThreadPool* pool = nullptr)
+        {
+            RotorVector rotors(std::max<size_t>(1, size / 2));
+            dispatch(pool, 0, rotors.size(), [&](size_t first, size_t last) {
+                for (size_t k = first; k < last; ++k)
+                {
+                    rotors[k] = calc_rotor(k, size);
+                }
+            });
+            return rotors;
+        }
+
+        static Workspace make_workspace(size_t size)
+        {
+            return CooleyTurkey::make_workspace(size);
+        }
+
+        /**
+         * @brief 呼び出し元のメモリ上でそのまま行うFFT(1/N化する)
+         * @note 引数はCooleyTurkey::fftと同じ.
+         */
+        static void fft(DDComplex* fouriers,
+                        size_t size,
+                        const RotorVector& rotors,
+                        const Workspace& workspace,
+                        ThreadPool* pool = nullptr,
+                        size_t extent = full_extent)
+        {
+            transform<false>(fouriers, size, rotors, workspace, pool, extent);
+        }
+
+        /**
+         * @brief 呼び出し元のメモリ上でそのまま行うIFFT(1/N化しない)
+         */
+        static void ifft(DDComplex* fouriers,
+                         size_t size,
+                         const RotorVector& rotors,
+                         const Workspace& workspace,
+                         ThreadPool* pool = nullptr,
+                         size_t extent = full_extent)
+        {
+            transform<true>(fouriers, size, rotors, workspace, pool, extent);
+        }
+
+        /**
+         * @brief 実数データの基準FFT
+         * @note ゼロ埋めしてcalc_size(size)点で変換する. 係数はFourier::fourier_coef()と同じ並び・規約.
+         */
+        template <class T>
+        static FourierVector reference_fft(const T* data, size_t size, ThreadPool* pool = nullptr)
+        {
+            size_t n = calc_size(size);
+            FourierVector fouriers(n);
+            for (size_t i = 0; i < n; ++i)
+            {
+                fouriers[i] = DDComplex(DDReal(i < size ? (double)data[i] : 0.0), DDReal(0.0));
+            }
+            fft(fouriers.data(), n, calc_rotors(n, pool), make_workspace(n), pool, size);
+            return fouriers;
+        }
+
+        /**
+         * @brief doubleの係数に丸める
+         */
+        static void to_complex(std::span<const DDComplex> in, std::span<std::complex<double>> out)
+        {
+            size_t n = std::min(in.size(), out.size());
+            for (size_t i = 0; i < n; ++i) { out[i] = in[i].to_complex(); }
+        }
+
+        /**
+         * @brief 検証対象の係数と基準との誤差
+         * @return 誤差の絶対値の最大値と、相対RMS誤差 sqrt{Σ|X - X_ref|^2 / Σ|X_ref|^2}
+         */
+        static std::pair<double, double>
+        compare(std::span<const std::complex<double>> coefs, std::span<const DDComplex> reference)
+        {
+            size_t n = std::min(coefs.size(), reference.size());
+            double max_error = 0.0;
+            DDReal error2(0.0);
+            DDReal norm2(0.0);
+            for (size_t i = 0; i < n; ++i)
+            {
+                DDReal dr = reference[i].re - DDReal(coefs[i].real());
+                DDReal di = reference[i].im - DDReal(coefs[i].imag());
+                DDReal e2 = dr * dr + di * di;
+                max_error = std::max(max_error, std::sqrt(e2.to_double()));
+                error2 = error2 + e2;
+                norm2 = norm2 + reference[i].re * reference[i].re + reference[i].im * reference[i].im;
+            }
+            double rms = norm2.hi > 0.0 ? std::sqrt(error2.to_double() / norm2.to_double()) : 0.0;
+            return std::make_pair(max_error, rms);
+        }
+
+    private:
+        template <bool Inverse>
+        static void transform(DDComplex* fouriers,
+                              size_t size,
+                              const RotorVector& rotors,
+                              const Workspace& workspace,
+                              ThreadPool* pool,
+                              size_t extent)
+        {
+            size_t half_size = size;
+            size_t butterfly_num = 1;
+            for (int i = 0; i < workspace.n_level; ++i)
+            {
+                half_size /= 2;
+                dispatch(pool, 0, size / 2, [&](size_t first, size_t last) {
+                    butterfly<Inverse>(fouriers, rotors.data(), half_size, butterfly_num, first, last, extent);
+                });
+                butterfly_num *= 2;
+            }
+
+            // ビットリバースの並べ替え. 順変換では同時に1/Nする(2のべき乗なので誤差なし)
+            const size_t* indice_map = workspace.indice_map.data();
+            double norm = Inverse ? 1.0 : 1.0 / size;
+            dispatch(pool, 0, size, [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; ++i)
+                {
+                    size_t j = indice_map[i];
+                    if (i < j)
+                    {
+                        auto f = fouriers[i];
+                        fouriers[i] = fouriers[j].scaled(norm);
+                        fouriers[j] = f.scaled(norm);
+                    }
+                    else if (i == j)
+                    {
+                        fouriers[i] = fouriers[i].scaled(norm);
+                    }
+                }
+            });
+        }
+    };
+}
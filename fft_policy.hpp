@@ -1,5 +1,8 @@
 #pragma once
 
+#include "thread_pool.hpp"
+#include "buffer_allocator.hpp"
+
 #include <complex>
 #include <vector>
 #include <tuple>
@@ -8,7 +11,7 @@
 #include <numeric>
 #include <stdexcept>
 #include <iostream>
-
+#include <limits>
 
 namespace fft
 {
@@ -33,6 +36,12 @@ namespace fft
                     break;
             }
             // std::printf("n_level: %zu\n", n_level);
+            if (n_level == 0)
+            {
+                // 1点の場合は並べ替え不要
+                std::fill(std::begin(indices), std::end(indices), 0);
+                return 0;
+            }
 
             // 参照インデックスマップを計算
             for (size_t index = 0; index < size; ++index)
@@ -55,10 +64,103 @@ namespace fft
             return n_level;
         }
 
+        template <bool Inverse>
+        static std::complex<double> rotor(const std::complex<double>* rotors, size_t index)
+        {
+            if constexpr (Inverse)
+                return std::conj(rotors[index]);
+            else
+                return rotors[index];
+        }
+
+        /**
+         * @brief 1レベル分のバタフライ演算のうち、通し番号[first, last)の区間を計算する
+         * 
+         * @param fouriers 
+         * @param rotors 
+         * @param half_size バタフライの片側の長さ(N/2, N/4, ...)
+         * @param butterfly_num このレベルのバタフライダイアグラムの個数(1, 2, 4, ...)
+         * @param first 
+         * @param last 
+         * @param extent 入力のうち非ゼロの可能性がある先頭からの長さ(ゼロ埋めを除いた元データの長さ)
+         * @note 周波数間引き型では、長さ2*half_sizeの各ブロックで非ゼロなのは先頭min(extent, 2*half_size)個だけ.
+         *       片側がゼロのバタフライは加算を省き、両側がゼロのバタフライは計算しない(ゼロのまま).
+         * @note Inverse = trueのときは回転子の共役を使う(逆変換).
+         */
+        template <bool Inverse>
+        static void butterfly(std::complex<double>* fouriers,
+                              const std::complex<double>* rotors,
+                              size_t half_size,
+                              size_t butterfly_num,
+                              size_t first,
+                              size_t last,
+                              size_t extent)
+        {
+            size_t nonzero = std::min(extent, 2 * half_size);
+            size_t full_end = nonzero > half_size ? nonzero - half_size : 0; // k < full_end: f1, f2ともに非ゼロ
+            size_t half_end = std::min(nonzero, half_size);                  // k < half_end: f1だけ非ゼロ
+
+            size_t j = first / half_size;
+            size_t k = first % half_size;
+            for (size_t b = first; b < last; ++j, k = 0)
+            {
+                size_t butterfly_offset = 2 * half_size * j; // 統治分割されたバタフライダイアグラムの先頭インデックス
+                size_t k_end = std::min(half_size, k + (last - b));
+                b += k_end - k;
+                for (; k < std::min(k_end, full_end); ++k)
+                {
+                    size_t j1 = butterfly_offset + k;
+                    size_t j2 = j1 + half_size;
+                    auto f1 = fouriers[j1];
+                    auto f2 = fouriers[j2];
+                    fouriers[j1] = f1 + f2; // 複素数での演算
+                    fouriers[j2] = rotor<Inverse>(rotors, k * butterfly_num) * (f1 - f2); // 1, 2, 4, 8, ...の倍数で回転子の添字の加算量が増える.
+                }
+                for (; k < std::min(k_end, half_end); ++k)
+                {
+                    // f2 = 0 なので f1 + f2 = f1 (そのまま)
+                    size_t j1 = butterfly_offset + k;
+                    fouriers[j1 + half_size] = rotor<Inverse>(rotors, k * butterfly_num) * fouriers[j1];
+                }
+                // 残りは入力も出力もゼロ
+                k = k_end;
+            }
+        }
+
+        /**
+         * @brief スレッドプールがあれば区間を分割して並列に、なければそのまま実行する
+         */
+        template <class Func>
+        static void dispatch(ThreadPool* pool, size_t begin, size_t end, Func&& func, size_t grain = parallel_grain)
+        {
+            if (pool)
+                pool->parallel_for(begin, end, grain, std::forward<Func>(func));
+            else
+                func(begin, end);
+        }
+
+        /**
+         * @brief スレッドプールがあれば区間とスレッドの対応を固定して並列に、なければそのまま実行する
+         */
+        template <class Func>
+        static void dispatch_static(ThreadPool* pool, size_t begin, size_t end, Func&& func)
+        {
+            if (pool)
+                pool->parallel_for_static(begin, end, std::forward<Func>(func));
+            else
+                func(begin, end);
+        }
+
 
     public:
-        using FourierVector = std::vector<std::complex<double>>;
-        using RotorVector = std::vector<std::complex<double>>;
+        /*並列化するときの1タスクあたりの最小要素数*/
+        static constexpr size_t parallel_grain = 1 << 14;
+
+        /*入力の全域が非ゼロの可能性がある(枝刈りしない)*/
+        static constexpr size_t full_extent = std::numeric_limits<size_t>::max();
+
+        using FourierVector = BufferVector<std::complex<double>>;
+        using RotorVector = BufferVector<std::complex<double>>;
 
         CooleyTurkey() {};
         ~CooleyTurkey() {};
@@ -97,53 +199,73 @@ namespace fft
             return std::make_tuple(exp_size, exp_size);
         }
 
+        /**
+         * @brief 変換の作業領域
+         * @note プラン時(Fourierの構築時)に一度だけ作り、変換のたびには確保しない.
+         */
+        struct Workspace
+        {
+            std::vector<size_t> indice_map; // ビットリバースで作成したインデックスマップ
+            int n_level = 0;                // べき乗レベル
+        };
+
+        /**
+         * @brief 2次元変換の作業領域
+         */
+        struct Workspace2D
+        {
+            Workspace width;          // 行方向の変換用
+            Workspace height;         // 列方向の変換用
+            FirstTouchVector<std::complex<double>> transpose; // 転置行列[width][height]
+        };
+
+        static Workspace make_workspace(size_t size)
+        {
+            Workspace workspace;
+            workspace.indice_map.resize(size);
+            workspace.n_level = indice_map_with_bit_reverse(workspace.indice_map);
+            return workspace;
+        }
+
+        static Workspace2D make_workspace_2d(size_t width, size_t height)
+        {
+            Workspace2D workspace;
+            workspace.width = make_workspace(width);
+            workspace.height = make_workspace(height);
+            workspace.transpose.resize(width * height); // ゼロ埋めしない(転置時に列ブロックの担当スレッドが最初に書き込む)
+            return workspace;
+        }
+
+    private:
+        /**
+         * @brief FFT/IFFTの本体
+         * @note Inverse = falseなら X_k = 1/N * Σ_n{W_k^n * x(n)}
+         * @note Inverse = trueなら  x(n) = Σ_k{W_k^-n * X_k} (1/N化しない. FFTの逆変換になる)
+         */
+        template <bool Inverse>
         static void
-        fft(FourierVector& fouriers, const RotorVector& rotors)
+        transform(std::complex<double>* fouriers,
+                  size_t size,
+                  const RotorVector& rotors,
+                  const Workspace& workspace,
+                  ThreadPool* pool,
+                  size_t extent)
         {
             /*周波数間引き型のFFT*/
             // https://qiita.com/tommyecguitar/items/c7f1049b308411dbd6d3
 
-            // ビットリバースを行ったインデックスマップを作成
-            std::vector<size_t> indice_map(fouriers.size());
-            int n_level = indice_map_with_bit_reverse(indice_map);
-            // std::printf("n_level: %d\n", n_level);
-
-            // n_levelは以下の計算でも求めることができる.
-            // int ex = (int)(std::log((double)fouriers.size()) / log(2.0));
-            // std::printf("ex: %d\n", ex);
-            
             /**
              * @brief バタフライ演算
+             * @note 各レベルのN/2個のバタフライは互いに独立なので、通し番号で区切ってスレッドに分配する.
              */
-            int half_size = fouriers.size();
-            int butterfly_num = 1;
-            int butterfly_offset, j1, j2, idx_w;
-            for (int i = 0; i < n_level; ++i) // 統治分割のレベル
+            size_t half_size = size;
+            size_t butterfly_num = 1;
+            for (int i = 0; i < workspace.n_level; ++i) // 統治分割のレベル
             {
                 half_size /= 2; // half_sizeは, N/2, N/4, ...
-                butterfly_offset = 0; // 統治分割されたバタフライダイアグラムの先頭インデックス
-                for (int j = 0; j < butterfly_num; ++j)
-                {
-                    idx_w = 0;
-                    for (int k = 0; k < half_size; ++k)
-                    {
-                        j1 = butterfly_offset + k;
-                        j2 = j1 + half_size;
-                        auto f1 = fouriers[j1];
-                        auto f2 = fouriers[j2];
-                        fouriers[j1] = f1 + f2; // 複素数での演算
-                        fouriers[j2] = rotors[idx_w] * (f1 - f2); // 複素数での演算
-                        idx_w += butterfly_num; // 1, 2, 4, 8, ...の倍数で回転子の添字の加算量が増える.
-                        // std::printf("i=%d, j=%d, k=%d\n", i, j, k);
-                    }
-                    // butterfly_offset
-                    // i==1 : N(使わない) 
-                    // i==2 : N/2
-                    // i==3 : N/4
-                    // i==4 : N/8
-                    // ...
-                    butterfly_offset += 2 * half_size;
-                }
+                dispatch(pool, 0, size / 2, [&](size_t first, size_t last) {
+                    butterfly<Inverse>(fouriers, rotors.data(), half_size, butterfly_num, first, last, extent);
+                });
                 butterfly_num *= 2;
             }
 
@@ -155,48 +277,108 @@ namespace fft
              * 未実装(統治分割法を理解してからかな？)
              */
 
-            // std::printf("FFT: fourier coef\n");
-            // for (auto& f : fouriers)
-            // {
-            //     std::cout << "Amp: " << std::abs(f) << ", Angle: " << std::arg(f) << std::endl;
-            // }
-
-            // for (size_t i = 0; i < indice_map.size(); ++i)
-            // {
-            //     std::printf("indice_map[%zu]=%zu\n", i, indice_map[i]);
-            // }
-
             // バタフライダイアグラムの出力配列の並びを替える(周波数間引き型)
-            FourierVector sorted_fouriers(fouriers.size());
-            for (size_t i = 0; i < sorted_fouriers.size(); ++i)
-            {   
-                sorted_fouriers[i] = fouriers[indice_map[i]];
-            }
+            // ビットリバースは対合なので、i < indice_map[i]の組を入れ替えれば作業用の配列はいらない.
+            // 順変換では複素フーリエ係数はN倍化されたままなので、同時に1/Nする
+            const size_t* indice_map = workspace.indice_map.data();
+            std::complex<double> norm(Inverse ? 1.0 : 1.0/size, 0.0);
+            dispatch(pool, 0, size, [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; ++i)
+                {
+                    size_t j = indice_map[i];
+                    if (i < j)
+                    {
+                        auto f = fouriers[i];
+                        if constexpr (Inverse)
+                        {
+                            fouriers[i] = fouriers[j];
+                            fouriers[j] = f;
+                        }
+                        else
+                        {
+                            fouriers[i] = fouriers[j] * norm; // 実部、虚部をsizeで割る.
+                            fouriers[j] = f * norm;
+                        }
+                    }
+                    else if (i == j && !Inverse)
+                    {
+                        fouriers[i] = fouriers[i] * norm;
+                    }
+                }
+            });
+        }
 
-            // std::printf("sorted FFT: fourier coef\n");
-            // for (auto& f : fouriers)
-            // {
-            //     std::cout << "Amp: " << std::abs(f) << ", Angle: " << std::arg(f) << std::endl;
-            // }
+    public:
+        /**
+         * @brief 呼び出し元のメモリ上でそのまま行うFFT
+         * @note ヒープ確保は行わない.
+         * 
+         * @param fouriers 長さsizeの入出力
+         * @param size workspaceと同じ2のべき乗
+         * @param rotors 長さsizeの回転子
+         * @param workspace make_workspace(size)で作った作業領域
+         * @param pool 
+         * @param extent 先頭から何個までが元データか. fouriers[extent...size-1]はゼロであること.
+         *               ゼロと分かっている入力に対するバタフライを省く(入力の枝刈り).
+         */
+        static void
+        fft(std::complex<double>* fouriers,
+            size_t size,
+            const RotorVector& rotors,
+            const Workspace& workspace,
+            ThreadPool* pool = nullptr,
+            size_t extent = full_extent)
+        {
+            transform<false>(fouriers, size, rotors, workspace, pool, extent);
+        }
 
+        /**
+         * @brief 呼び出し元のメモリ上でそのまま行うIFFT
+         * @note x(n) = Σ_k{W_k^-n * X_k}. fftの出力(1/N化済み)を元の値に戻す.
+         * @note 引数はfftと同じ.
+         */
+        static void
+        ifft(std::complex<double>* fouriers,
+             size_t size,
+             const RotorVector& rotors,
+             const Workspace& workspace,
+             ThreadPool* pool = nullptr,
+             size_t extent = full_extent)
+        {
+            transform<true>(fouriers, size, rotors, workspace, pool, extent);
+        }
 
-            // 複素フーリエ係数はN倍化されたままなので、1/Nする
-            size_t size = sorted_fouriers.size();
-            std::complex<double> norm(1.0/size, 0.0);
-            std::for_each(std::begin(sorted_fouriers), std::end(sorted_fouriers), 
-            [&norm](auto& value) {
-                value = value * norm; // 実部、虚部をsizeで割る.
-            });
+        static void
+        fft(FourierVector& fouriers,
+            const RotorVector& rotors,
+            const Workspace& workspace,
+            ThreadPool* pool = nullptr,
+            size_t extent = full_extent)
+        {
+            fft(fouriers.data(), fouriers.size(), rotors, workspace, pool, extent);
+        }
 
-            // 元の引数に演算結果を返す
-            fouriers = sorted_fouriers;
+        static void
+        fft(FourierVector& fouriers, const RotorVector& rotors, ThreadPool* pool = nullptr)
+        {
+            // 作業領域を使い回さない場合(毎回確保する)
+            fft(fouriers, rotors, make_workspace(fouriers.size()), pool);
         }
 
         static void
-        fft2d(FourierVector& fouriers,
+        fft2d(std::complex<double>* fouriers,
               const RotorVector& rotors_width,
-              const RotorVector& rotors_height)
+              const RotorVector& rotors_height,
+              Workspace2D& workspace,
+              ThreadPool* pool = nullptr,
+              size_t extent_width = full_extent,
+              size_t extent_height = full_extent)
         {
+            /**
+             * @note fouriersは行優先の[rotors_height.size()][rotors_width.size()].
+             * @note extent_width, extent_heightはゼロ埋め前の画像サイズ.
+             *       範囲外の行は変換してもゼロのままなので飛ばし、各行・各列は入力の枝刈りを行う.
+             */
             /**
              * @brief ToDo
              * 1. 画像の行ごとにフーリエ変換
@@ -208,50 +390,73 @@ namespace fft
             size_t width = rotors_width.size();
             size_t height = rotors_height.size();
 
-            std::cout << "FftPolicy::fft2d" << std::endl;
-
             // 1. 画像の行ごとにフーリエ変換
-            size_t i = 0;
-            auto j = std::begin(fouriers);
-            for (;
-                 i < height;
-                 ++i, j += width)
-            {
-                FourierVector fourier_row(j, j + width);
-                fft(fourier_row, rotors_width);
-                std::copy(std::begin(fourier_row), std::end(fourier_row), j);
-            }
+            // 行は連続しているので、その場で変換する.
+            // 行ブロックとスレッドの対応を固定し、Fourier2Dの構築時にファーストタッチした行をそのスレッドが変換する.
+            // 長い行は行の中でも並列化される.
+            dispatch_static(pool, 0, height, [&](size_t first, size_t last) {
+                for (size_t i = first; i < std::min(last, extent_height); ++i)
+                {
+                    fft(fouriers + i * width, width, rotors_width, workspace.width, pool, extent_width);
+                }
+            });
 
             // 2. 複素フーリエ係数行列を転値
-            FourierVector f_transpose(width * height);
-            for (size_t j = 0; j < height; ++j)
-            {
-                for (size_t i = 0; i < width; ++i)
+            // 転置先は作業領域にあり、初回は列ブロックを担当するスレッドが最初に書き込む.
+            auto& f_transpose = workspace.transpose;
+            dispatch_static(pool, 0, width, [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; ++i)
                 {
-                    f_transpose.at(i * height + j) = fouriers.at(j * width + i);
+                    for (size_t j = 0; j < height; ++j)
+                    {
+                        f_transpose[i * height + j] = fouriers[j * width + i];
+                    }
                 }
-            }
+            });
 
             // 3. 画像の行(列)ごとにフーリエ変換
-            i = 0;
-            j = std::begin(f_transpose);
-            for (;
-                 i < width;
-                 ++i, j += height)
-            {
-                FourierVector fourier_row(j, j + height);
-                fft(fourier_row, rotors_height);
-                std::copy(std::begin(fourier_row), std::end(fourier_row), j);
-            }
+            // 2と同じ分割なので、各スレッドは自分が書き込んだ列を変換する.
+            dispatch_static(pool, 0, width, [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; ++i)
+                {
+                    fft(f_transpose.data() + i * height, height, rotors_height, workspace.height, pool, extent_height);
+                }
+            });
 
             // 4. 2と同じことを行う
-            for (size_t j = 0; j < height; ++j)
-            {
-                for (size_t i = 0; i < width; ++i)
+            // 書き込み先の行ブロックは1と同じ分割にする.
+            dispatch_static(pool, 0, height, [&](size_t first, size_t last) {
+                for (size_t j = first; j < last; ++j)
                 {
-                    fouriers.at(j * width + i) = f_transpose.at(i * height + j);
+                    for (size_t i = 0; i < width; ++i)
+                    {
+                        fouriers[j * width + i] = f_transpose[i * height + j];
+                    }
                 }
-            }
+            });
+        }
+
+        static void
+        fft2d(FourierVector& fouriers,
+              const RotorVector& rotors_width,
+              const RotorVector& rotors_height,
+              Workspace2D& workspace,
+              ThreadPool* pool = nullptr,
+              size_t extent_width = full_extent,
+              size_t extent_height = full_extent)
+        {
+            fft2d(fouriers.data(), rotors_width, rotors_height, workspace, pool, extent_width, extent_height);
+        }
+
+        static void
+        fft2d(FourierVector& fouriers,
+              const RotorVector& rotors_width,
+              const RotorVector& rotors_height,
+              ThreadPool* pool = nullptr)
+        {
+            // 作業領域を使い回さない場合(毎回確保する)
+            Workspace2D workspace = make_workspace_2d(rotors_width.size(), rotors_height.size());
+            fft2d(fouriers, rotors_width, rotors_height, workspace, pool);
         }
     };
 }
\ No newline at end of file
@@ -0,0 +1,310 @@
+#pragma once
+
+#include "fft_policy.hpp"
+
+#include <cmath>
+#include <complex>
+#include <vector>
+#include <algorithm>
+#include <span>
+
+
+namespace fft
+{
+    /**
+     * @brief 高速ハートレー変換(FHT)のポリシー
+     * @note H_k = 1/N * Σ_n{x(n) * cas(2*pi*k*n/N)}, cas(t) = cos(t) + sin(t).
+     *       実数から実数への変換なので、データも回転子も実数で持ち、複素数のFFTの半分のメモリで済む.
+     * @note このライブラリのFFTの規約 X_k = 1/N * Σ_n{x(n) * exp{+j*2*pi*k*n/N}} とは
+     *       H_k = Re(X_k) + Im(X_k), X_k = {(H_k + H_{N-k}) + j*(H_k - H_{N-k})} / 2 の関係にある.
+     * @note DHTは自分自身が逆変換(N倍を除く)なので、ifhtはfhtの1/N化をしないだけ.
+     * @note 時間間引き型の基数2. k と h-k の組を一緒に計算すると、同じ4要素だけを読み書きするのでその場で変換できる.
+     */
+    class Hartley
+    {
+        /**
+         * @brief 長さ2の変換(1段目)
+         */
+        static void first_level(double* data, size_t first, size_t last)
+        {
+            for (size_t i = first; i < last; ++i)
+            {
+                double a = data[2 * i];
+                double b = data[2 * i + 1];
+                data[2 * i] = a + b;
+                data[2 * i + 1] = a - b;
+            }
+        }
+
+        /**
+         * @brief 長さ2hの変換(前半h点・後半h点の変換から)のうち、通し番号[first, last)の区間を計算する
+         * @note T_k = O_k * cos(t) + O_{h-k} * sin(t) (t = 2*pi*k/2h) とすると
+         *       H_k = E_k + T_k, H_{k+h} = E_k - T_k. 通し番号1つで k と h-k (0 <= k < h/2)の組を受け持つ.
+         * @param rotors cos(2*pi*i/N) (i = 0...N/4)
+         * @param stride 回転子の添字の間隔 N/2h
+         */
+        static void butterfly(double* data,
+                              const double* rotors,
+                              size_t half_size,
+                              size_t stride,
+                              size_t quarter,
+                              size_t first,
+                              size_t last)
+        {
+            const size_t pairs = half_size / 2;
+            size_t j = first / pairs;
+            size_t k = first % pairs;
+            for (size_t b = first; b < last; ++j, k = 0)
+            {
+                double* e = data + 2 * half_size * j; // 前半(偶数番目の変換)
+                double* o = e + half_size;            // 後半(奇数番目の変換)
+                size_t k_end = std::min(pairs, k + (last - b));
+                b += k_end - k;
+                if (k == 0)
+                {
+                    // k = 0: T = O_0, k = h/2: T = O_{h/2} (cos = 0, sin = 1)
+                    double e0 = e[0], o0 = o[0];
+                    e[0] = e0 + o0;
+                    o[0] = e0 - o0;
+                    double eh = e[pairs], oh = o[pairs];
+                    e[pairs] = eh + oh;
+                    o[pairs] = eh - oh;
+                    ++k;
+                }
+                for (; k < k_end; ++k)
+                {
+                    double c = rotors[k * stride];
+                    double s = rotors[quarter - k * stride];
+                    double ok = o[k];
+                    double on = o[half_size - k];
+                    double t1 = ok * c + on * s;  // T_k
+                    double t2 = ok * s - on * c;  // T_{h-k}
+                    double ek = e[k];
+                    double en = e[half_size - k];
+                    e[k] = ek + t1;
+                    o[k] = ek - t1;
+                    e[half_size - k] = en + t2;
+                    o[half_size - k] = en - t2;
+                }
+            }
+        }
+
+        template <class Func>
+        static void dispatch(ThreadPool* pool, size_t begin, size_t end, Func&& func)
+        {
+            if (pool)
+                pool->parallel_for(begin, end, parallel_grain, std::forward<Func>(func));
+            else
+                func(begin, end);
+        }
+
+    public:
+        static constexpr size_t parallel_grain = CooleyTurkey::parallel_grain;
+
+        using DataVector = BufferVector<double>;
+        using RotorVector = BufferVector<double>;
+        using Workspace = CooleyTurkey::Workspace;
+        using FourierVector = CooleyTurkey::FourierVector;
+
+        static size_t calc_size(size_t size)
+        {
+            return CooleyTurkey::calc_size(size);
+        }
+
+        /**
+         * @brief 回転子 cos(2*pi*i/N) (i = 0...N/4)
+         * @note sinは sin(2*pi*i/N) = cos(2*pi*(N/4-i)/N) で同じ表から引く.
+         */
+        static RotorVector calc_rotors(size_t size)
+        {
+            RotorVector rotors(size / 4 + 1);
+            double base_freq = 2 * 3.141592653589793 / size;
+            for (size_t i = 0; i < rotors.size(); ++i)
+            {
+                rotors[i] = std::cos(base_freq * i);
+            }
+            if (size >= 4)
+                rotors[size / 4] = 0.0;
+            return rotors;
+        }
+
+        static Workspace make_workspace(size_t size)
+        {
+            return CooleyTurkey::make_workspace(size);
+        }
+
+        /**
+         * @brief 呼び出し元のメモリ上でそのまま行うFHT(1/N化する)
+         * @note ヒープ確保は行わない.
+         *
+         * @param data 長さsizeの入出力
+         * @param size workspaceと同じ2のべき乗
+         * @param rotors calc_rotors(size)
+         * @param workspace make_workspace(size)
+         * @param pool
+         */
+        static void fht(double* data,
+                        size_t size,
+                        const RotorVector& rotors,
+                        const Workspace& workspace,
+                        ThreadPool* pool = nullptr)
+        {
+            transform<false>(data, size, rotors, workspace, pool);
+        }
+
+        /**
+         * @brief 呼び出し元のメモリ上でそのまま行う逆FHT(1/N化しない)
+         * @note x(n) = Σ_k{H_k * cas(2*pi*k*n/N)}. fhtの出力を元の値に戻す.
+         */
+        static void ifht(double* data,
+                         size_t size,
+                         const RotorVector& rotors,
+                         const Workspace& workspace,
+                         ThreadPool* pool = nullptr)
+        {
+            transform<true>(data, size, rotors, workspace, pool);
+        }
+
+        /**
+         * @brief ハートレー係数をフーリエ係数(fftと同じ規約・並び)にする
+         * @note X_k = {(H_k + H_{N-k}) + j*(H_k - H_{N-k})} / 2
+         */
+        static bool to_fourier(std::span<const double> hartley, std::span<std::complex<double>> coefs)
+        {
+            size_t n = hartley.size();
+            if (coefs.size() < n)
+                return false;
+            for (size_t k = 0; k < n; ++k)
+            {
+                double h1 = hartley[k];
+                double h2 = hartley[(n - k) % n];
+                coefs[k] = std::complex<double>(0.5 * (h1 + h2), 0.5 * (h1 - h2));
+            }
+            return true;
+        }
+
+        /**
+         * @brief 実数データのフーリエ係数(エルミート対称)をハートレー係数にする
+         * @note H_k = Re(X_k) + Im(X_k)
+         */
+        static bool from_fourier(std::span<const std::complex<double>> coefs, std::span<double> hartley)
+        {
+            size_t n = coefs.size();
+            if (hartley.size() < n)
+                return false;
+            for (size_t k = 0; k < n; ++k)
+            {
+                hartley[k] = coefs[k].real() + coefs[k].imag();
+            }
+            return true;
+        }
+
+        /**
+         * @brief ハートレー領域での巡回畳み込みの積(その場でaに書き込む)
+         * @note z = x ⊛ y のとき Z_k = N/2 * {X_k * (Y_k + Y_{N-k}) + X_{N-k} * (Y_k - Y_{N-k})} (係数は1/N化済み).
+         *       k と N-k を組にして計算するので、aをその場で上書きできる. ifhtすれば畳み込みになる.
+         */
+        static void multiply(double* a, const double* b, size_t size, ThreadPool* pool = nullptr)
+        {
+            const double half = 0.5 * size;
+            a[0] = size * a[0] * b[0];
+            if (size < 2)
+                return;
+            a[size / 2] = size * a[size / 2] * b[size / 2];
+            dispatch(pool, 1, size / 2, [&](size_t first, size_t last) {
+                for (size_t k = first; k < last; ++k)
+                {
+                    size_t nk = size - k;
+                    double xk = a[k], xn = a[nk];
+                    double ys = b[k] + b[nk];
+                    double yd = b[k] - b[nk];
+                    a[k] = half * (xk * ys + xn * yd);
+                    a[nk] = half * (xn * ys - xk * yd);
+                }
+            });
+        }
+
+        /**
+         * @brief 実数列の線形畳み込み out = a * b
+         * @note 長さ calc_size(|a| + |b| - 1) の実数の作業領域2本だけで計算する(複素数のFFTの半分).
+         * @param out 長さ|a| + |b| - 1 以上
+         * @return outが短ければfalse
+         */
+        template <class T>
+        static bool convolve(std::span<const T> a, std::span<const T> b, std::span<double> out, ThreadPool* pool = nullptr)
+        {
+            if (a.empty() || b.empty())
+                return true;
+            size_t length = a.size() + b.size() - 1;
+            if (out.size() < length)
+                return false;
+            size_t size = calc_size(length);
+
+            auto rotors = calc_rotors(size);
+            auto workspace = make_workspace(size);
+            DataVector ha(size);
+            DataVector hb(size);
+            auto load = [&](DataVector& h, std::span<const T> x) {
+                dispatch(pool, 0, size, [&](size_t first, size_t last) {
+                    for (size_t i = first; i < last; ++i)
+                    {
+                        h[i] = i < x.size() ? (double)x[i] : 0.0;
+                    }
+                });
+            };
+            load(ha, a);
+            load(hb, b);
+            fht(ha.data(), size, rotors, workspace, pool);
+            fht(hb.data(), size, rotors, workspace, pool);
+            multiply(ha.data(), hb.data(), size, pool);
+            ifht(ha.data(), size, rotors, workspace, pool);
+            std::copy(std::begin(ha), std::begin(ha) + length, std::begin(out));
+            return true;
+        }
+
+    private:
+        template <bool Inverse>
+        static void transform(double* data,
+                              size_t size,
+                              const RotorVector& rotors,
+                              const Workspace& workspace,
+                              ThreadPool* pool)
+        {
+            if (size < 2)
+                return;
+
+            // 時間間引き型なので、先にビットリバースで並べ替える. 順変換では同時に1/Nする
+            const size_t* indice_map = workspace.indice_map.data();
+            double norm = Inverse ? 1.0 : 1.0 / size;
+            dispatch(pool, 0, size, [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; ++i)
+                {
+                    size_t j = indice_map[i];
+                    if (i < j)
+                    {
+                        double d = data[i];
+                        data[i] = data[j] * norm;
+                        data[j] = d * norm;
+                    }
+                    else if (i == j && !Inverse)
+                    {
+                        data[i] *= norm;
+                    }
+                }
+            });
+
+            dispatch(pool, 0, size / 2, [&](size_t first, size_t last) {
+                first_level(data, first, last);
+            });
+
+            const size_t quarter = size / 4;
+            for (size_t half_size = 2; half_size < size; half_size *= 2)
+            {
+                size_t stride = size / (2 * half_size);
+                dispatch(pool, 0, size / 4, [&](size_t first, size_t last) {
+                    butterfly(data, rotors.data(), half_size, stride, quarter, first, last);
+                });
+            }
+        }
+    };
+}
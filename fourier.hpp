@@ -5,9 +5,33 @@
 #include <complex>
 #include <vector>
 #include <algorithm>
+#include <memory>
+#include <span>
+#include <cmath>
+#include <random>
+#include <utility>
+#include <limits>
 // #include <numbers>
 
 
+/**
+ * @brief スパースFFTのパラメータ
+ * @note バケット数・ラウンド数を増やすと精度が上がり、遅くなる.
+ */
+struct SparseFftParams
+{
+    size_t num_buckets = 0;           // ハッシュのバケット数B(2のべき乗に切り上げ). 0ならbucket_factor * k
+    size_t bucket_factor = 8;         // 成分1つあたりのバケット数
+    size_t num_rounds = 7;            // ランダムな置換を変えて繰り返す回数
+    size_t min_votes = 0;             // 何ラウンドで見つかれば採用するか. 0なら過半数
+    double leakage = 1e-9;            // フィルタの阻止域の大きさ(隣のバケットへの漏れ)
+    double relative_threshold = 1e-6; // 最大のバケットに対してこれより小さいバケットは空とみなす
+    int shift_step_bits = 1;          // 周波数の特定で時間シフトを何ビットずつ伸ばすか. 大きいと速いが雑音に弱い
+    bool refine = false;              // 見つけた周波数の係数をGoertzelで計算し直す(O(size * k))
+    unsigned int seed = 0;            // 置換を選ぶ乱数の種
+};
+
+
 template <class FftPolicy>
 class Fourier 
 {
@@ -19,7 +43,8 @@ class Fourier
      * @note Nはサンプリング数
      */
     using Rotor = std::complex<double>;
-    std::vector<Rotor> rotors_; // 1次元
+    using RotorVector = typename FftPolicy::RotorVector;
+    RotorVector rotors_; // 1次元
 
     /**
      * @brief 複素フーリエ係数
@@ -27,13 +52,21 @@ class Fourier
      * @note N倍されているので、振幅・位相として使用するときは1/N倍すること.
      */
     using FourierCoef = std::complex<double>;
-    std::vector<FourierCoef> fouriers_;
+    using FourierVector = typename FftPolicy::FourierVector;
+    FourierVector fouriers_;
+
+    /**
+     * @brief fouriers_にfft/dftの結果が入っているか
+     * @note fouriers_は構築時に確保するだけなので、サイズでは判定できない. take_coefficients()で戻る.
+     */
+    bool has_coefficients_;
 
     /**
      * @brief データ領域
      * @note 元データにゼロ埋めパディングを施したもの
      */
-    std::vector<double> data_;
+    using DataVector = fft::BufferVector<double>;
+    DataVector data_;
 
     /**
      * @brief データサイズ
@@ -41,14 +74,217 @@ class Fourier
      */
     size_t size_;
 
+    /**
+     * @brief 変換の作業領域
+     * @note 構築時に一度だけ確保し、fftのたびにヒープを確保しない.
+     */
+    typename FftPolicy::Workspace workspace_;
+
+    /**
+     * @brief 実数入力の変換(N/2点の複素FFT)の回転子・作業領域・係数
+     * @note rfft/irfft/ifft/analytic_signalを最初に使うときに作る.
+     */
+    RotorVector half_rotors_;
+    typename FftPolicy::Workspace half_workspace_;
+    FourierVector half_; // N/2+1個
+
+    /**
+     * @brief 出力を枝刈りするFFT(fft_range)のL点の回転子・作業領域・間引いた系列
+     * @note 最初に使うときとLが変わったときだけ作り直し、同じLなら使い回す.
+     */
+    RotorVector range_rotors_;
+    typename FftPolicy::Workspace range_workspace_;
+    FourierVector range_decimated_; // L個
+    FourierVector range_bins_;      // fft_binsが拾う連続したビン
+
+    /**
+     * @brief 1回の変換を並列化するスレッドプール
+     * @note nullptrなら逐次実行. コピーしたオブジェクト間では共有される.
+     */
+    std::shared_ptr<fft::ThreadPool> pool_;
+
+    /*Goertzelで1回の走査に同時に計算するビンの数*/
+    static constexpr size_t goertzel_lanes = 8;
+
+    /**
+     * @brief Goertzelアルゴリズムで複数の周波数ビンを計算する
+     * @note ビンごとに2次の漸化式 s(n) = x(n) + 2cos(2*pi*k/N)*s(n-1) - s(n-2) を回す. 計算量O(size)/ビン
+     * @note Σ_n{x(n) * W_k^n} = W_k^size * {s(size) - W_k * s(size-1)} (size以降はゼロ埋め扱い)
+     * @note goertzel_lanes個のビンの漸化式を1回の入力の走査でまとめて進める.
+     *       レーン間に依存がないので内側のループはSIMD化され、漸化式の遅延も隠れる.
+     */
+    template <class T>
+    void goertzel(const T* data, size_t size, std::span<const size_t> bins, std::span<FourierCoef> out) const
+    {
+        for (size_t i0 = 0; i0 < bins.size(); i0 += goertzel_lanes)
+        {
+            size_t n_lanes = std::min(goertzel_lanes, bins.size() - i0);
+            double coeff[goertzel_lanes] = {};
+            double s1[goertzel_lanes] = {}; // s(n-1)
+            double s2[goertzel_lanes] = {}; // s(n-2)
+            for (size_t l = 0; l < n_lanes; ++l)
+            {
+                coeff[l] = 2 * rotors_[bins[i0 + l] % size_].real();
+            }
+
+            for (size_t n = 0; n < size; ++n)
+            {
+                double x = (double)data[n];
+                for (size_t l = 0; l < goertzel_lanes; ++l)
+                {
+                    double s0 = x + coeff[l] * s1[l] - s2[l];
+                    s2[l] = s1[l];
+                    s1[l] = s0;
+                }
+            }
+
+            for (size_t l = 0; l < n_lanes; ++l)
+            {
+                size_t k = bins[i0 + l] % size_;
+                double s0 = coeff[l] * s1[l] - s2[l]; // s(size) (入力はゼロ)
+                FourierCoef value = rotors_[(k * (size % size_)) % size_] * (s0 - rotors_[k] * s1[l]);
+                out[i0 + l] = value * FourierCoef(1.0/size_, 0.0); // 1/N化する
+            }
+        }
+    }
+
+    /**
+     * @brief fft_rangeのL点の回転子・作業領域を用意する(同じLなら何もしない)
+     */
+    void prepare_range(size_t L)
+    {
+        if (range_rotors_.size() == L)
+            return;
+
+        // L点FFTの回転子はN点の回転子をP個おきに取り出したもの
+        const size_t P = size_ / L;
+        range_rotors_.resize(L);
+        for (size_t j = 0; j < L; ++j) { range_rotors_[j] = rotors_[j * P]; }
+        range_workspace_ = FftPolicy::make_workspace(L);
+        range_decimated_.resize(L);
+    }
+
+    /**
+     * @brief スパースFFTのフィルタの周波数応答
+     * @note 時間窓 G(t) = B * exp{-t^2/(2*s^2)} * sin(2*pi*a*t)/(pi*t) のDTFTを1/B倍したもの.
+     *       幅2aの矩形とガウス関数の畳み込みなので、誤差関数の差で書ける.
+     * @param nu 周波数(1サンプルあたりの周期数)
+     */
+    static double sparse_filter_response(double nu, double half_band, double sigma_t)
+    {
+        const double c = std::sqrt(2.0) * 3.141592653589793 * sigma_t;
+        return 0.5 * (std::erf(c * (nu + half_band)) - std::erf(c * (nu - half_band)));
+    }
+
+    /**
+     * @brief 実数データのFFT. ビン0...N/2(N/2+1個)をhalfに出力する
+     * @note M = N/2として z(m) = x(2m) + j*x(2m+1) をM点FFTし(Z_k = E_k + j*O_k)、
+     *       X_k = {E_k + W_k * O_k} / 2, E_k = {Z_k + conj(Z_{M-k})} / 2, O_k = {Z_k - conj(Z_{M-k})} / 2j で分ける.
+     *       kとM-kを組にして計算するので、その場で書き換えられる.
+     */
+    template <class T>
+    void forward_real(const T* data, size_t size, FourierCoef* half, fft::ThreadPool* pool) const
+    {
+        const size_t m = size_ / 2;
+        if (m == 0)
+        {
+            half[0] = FourierCoef(size > 0 ? (double)data[0] : 0.0, 0.0);
+            return;
+        }
+
+        for (size_t i = 0; i < m; ++i)
+        {
+            double re = 2 * i < size ? (double)data[2 * i] : 0.0;
+            double im = 2 * i + 1 < size ? (double)data[2 * i + 1] : 0.0;
+            half[i] = FourierCoef(re, im);
+        }
+        FftPolicy::fft(half, m, half_rotors_, half_workspace_, pool, (size + 1) / 2); // 1/M化される
+
+        for (size_t k = 0; k <= m / 2; ++k)
+        {
+            FourierCoef a = half[k];
+            FourierCoef b = std::conj(half[k == 0 ? 0 : m - k]);
+            FourierCoef e = (a + b) * 0.5;
+            FourierCoef wo = rotors_[k] * (a - b) * FourierCoef(0.0, -0.5);
+            half[k] = (e + wo) * 0.5;
+            half[m - k] = std::conj(e - wo) * 0.5; // k = 0ならビンN/2
+        }
+    }
+
+    /**
+     * @brief エルミート対称な係数(ビン0...N/2)の逆変換 x(n) = Σ_k{W_k^-n * X_k}
+     * @note forward_realの逆. E_k = X_k + conj(X_{M-k}), O_k = {X_k - conj(X_{M-k})} * W_k^-1 から
+     *       Z_k = E_k + j*O_k を作ってM点IFFTすると z(m) = x(2m) + j*x(2m+1) になる.
+     * @note halfは作業領域として書き換えられる. 結果はstore(n, x(n))で受け取る.
+     */
+    template <class Store>
+    void inverse_real(FourierCoef* half, fft::ThreadPool* pool, Store&& store) const
+    {
+        const size_t m = size_ / 2;
+        if (m == 0)
+        {
+            store(0, half[0].real());
+            return;
+        }
+
+        for (size_t k = 0; k <= m / 2; ++k)
+        {
+            FourierCoef a = half[k];
+            FourierCoef b = std::conj(half[m - k]);
+            FourierCoef e = a + b;
+            FourierCoef o = (a - b) * std::conj(rotors_[k]);
+            half[k] = e + FourierCoef(0.0, 1.0) * o;
+            if (k > 0)
+                half[m - k] = std::conj(e) + FourierCoef(0.0, 1.0) * std::conj(o);
+        }
+        FftPolicy::ifft(half, m, half_rotors_, half_workspace_, pool);
+
+        for (size_t i = 0; i < m; ++i)
+        {
+            store(2 * i, half[i].real());
+            store(2 * i + 1, half[i].imag());
+        }
+    }
+
+    /**
+     * @brief 解析信号 z = x + j*H{x} の本体
+     * @note この規約(W_k = exp{+j*2*pi*k/N})では正の周波数はビン(N/2, N)にある.
+     *       解析信号のスペクトルはビン(N/2, N)を2倍、(0, N/2)を0にしたもので、
+     *       虚部 H{x} のスペクトルは Y_k = j*X_k (0 < k < N/2), -j*X_k (N/2 < k < N), Y_0 = Y_N/2 = 0.
+     *       H{x}は実数なので、ビン0...N/2だけにマスクを掛けて実数の逆変換をすればよい(順・逆ともN/2点FFT).
+     */
+    template <class T>
+    void analytic_core(const T* data, size_t size, FourierCoef* half, fft::ThreadPool* pool, FourierCoef* out) const
+    {
+        const size_t m = size_ / 2;
+        forward_real(data, size, half, pool);
+        half[0] = FourierCoef(0.0, 0.0);
+        half[m] = FourierCoef(0.0, 0.0);
+        for (size_t k = 1; k < m; ++k)
+        {
+            half[k] = FourierCoef(-half[k].imag(), half[k].real()); // j倍
+        }
+        inverse_real(half, pool, [&](size_t n, double value) {
+            if (n < size)
+                out[n] = FourierCoef((double)data[n], value);
+        });
+    }
+
 public:
-    Fourier(size_t size)
+    Fourier(size_t size, std::shared_ptr<fft::ThreadPool> pool = nullptr)
+        : pool_(std::move(pool))
     {
         // 1. フーリエ変換に必要なデータサイズを計算
         size_ = FftPolicy::calc_size(size);
 
         // 2. 回転子W_k,nを作成
         rotors_ = FftPolicy::calc_rotors(size_);
+
+        // 3. 作業領域とデータ領域を確保
+        workspace_ = FftPolicy::make_workspace(size_);
+        data_.resize(size_);
+        fouriers_.resize(size_);
+        has_coefficients_ = false;
     }
 
     virtual ~Fourier() {};
@@ -57,7 +293,7 @@ public:
     Fourier(Fourier&&) = default;
     Fourier& operator=(Fourier&&) = default;
 
-    std::vector<std::complex<double>> rotors() const
+    const RotorVector& rotors() const
     {
         return rotors_;
     }
@@ -67,16 +303,55 @@ public:
         return size_;
     }
 
-    std::vector<double> zero_padding_data() const
+    void set_thread_pool(std::shared_ptr<fft::ThreadPool> pool)
+    {
+        pool_ = std::move(pool);
+    }
+
+    std::shared_ptr<fft::ThreadPool> thread_pool() const
+    {
+        return pool_;
+    }
+
+    const DataVector& zero_padding_data() const
     {
         return data_;
     }
 
-    std::vector<FourierCoef> fourier_coef() const
+    const FourierVector& fourier_coef() const
     {
         return fouriers_;
     }
 
+    /**
+     * @brief 複素フーリエ係数のビュー(コピーしない)
+     * @note 次のfft/dftで内容が書き換わる. take_coefficients()の後は空になる.
+     */
+    std::span<const FourierCoef> fourier_coef_view() const
+    {
+        return std::span<const FourierCoef>(fouriers_.data(), fouriers_.size());
+    }
+
+    std::span<const Rotor> rotors_view() const
+    {
+        return std::span<const Rotor>(rotors_.data(), rotors_.size());
+    }
+
+    std::span<const double> zero_padding_data_view() const
+    {
+        return std::span<const double>(data_.data(), data_.size());
+    }
+
+    /**
+     * @brief 複素フーリエ係数をムーブで取り出す
+     * @note 取り出した後のfourier_coef()は空. 次のfftで再確保される.
+     */
+    FourierVector take_coefficients()
+    {
+        has_coefficients_ = false;
+        return std::move(fouriers_);
+    }
+
     bool dft(double* data, size_t size)
     {
         /*むちゃくちゃ遅いので、検証用に使うこと*/
@@ -85,8 +360,9 @@ public:
 
         data_.resize(size_);
         std::fill(std::begin(data_), std::end(data_), (double)0); // 0ゼロ埋め
-        for (size_t i = 0; i < size_; ++i) { data_[i] = data[i]; }
+        for (size_t i = 0; i < size; ++i) { data_[i] = data[i]; }
         fouriers_.resize(size_);
+        std::fill(std::begin(fouriers_), std::end(fouriers_), FourierCoef(0.0, 0.0)); // 下で足し込むのでゼロ埋め
 
         // 回転子行列W_k,nを作成
         std::vector<Rotor> mtx_rotors(size_ * size_);
@@ -117,6 +393,7 @@ public:
         std::for_each(std::begin(fouriers_), std::end(fouriers_), [&](auto& value) {
             value = value * std::complex<double>(1.0/size_, 0.0);
         });
+        has_coefficients_ = true;
                 
         return true;
     }
@@ -136,7 +413,7 @@ public:
         // ゼロ埋めデータの作成
         data_.resize(size_);
         std::fill(std::begin(data_), std::end(data_), (double)0); // ゼロ埋め
-        for (size_t i = 0; i < size_; ++i) { data_[i] = data[i]; } // 端数はゼロ埋めされてる
+        for (size_t i = 0; i < size; ++i) { data_[i] = data[i]; } // 端数はゼロ埋めされてる
 
         // 複素フーリエ係数の準備
         fouriers_.resize(data_.size()); // N倍されて出力される
@@ -147,15 +424,678 @@ public:
         }
 
         // ポリシーが受け持つ独自アルゴリズムに任せる
-        FftPolicy::fft(fouriers_, rotors_);
+        // ゼロ埋めした部分に対するバタフライは省かれる
+        FftPolicy::fft(fouriers_, rotors_, workspace_, pool_.get(), size);
+        has_coefficients_ = true;
 
         return true;
     }
 
+    /**
+     * @brief 呼び出し元のメモリに直接出力するFFT
+     * @note data_, fouriers_は使わない(zero_padding_data(), fourier_coef()は更新されない).
+     * 
+     * @param in 長さsize()以下の実数データ. 足りない分はゼロ埋めとして扱う
+     * @param out 長さsize()の出力先
+     */
+    template <class T>
+    bool fft(std::span<const T> in, std::span<std::complex<double>> out)
+    {
+        if (in.size() > size_ || out.size() != size_)
+            return false;
+
+        // ゼロ埋めしながら複素数にする
+        for (size_t i = 0; i < in.size(); ++i) { out[i] = std::complex<double>(in[i], 0.0); }
+        std::fill(std::begin(out) + in.size(), std::end(out), std::complex<double>(0.0, 0.0));
+
+        FftPolicy::fft(out.data(), size_, rotors_, workspace_, pool_.get(), in.size());
+        return true;
+    }
+
+    /**
+     * @brief 呼び出し元の複素数データをその場で変換するFFT
+     * @note コピーは一切行わない.
+     * 
+     * @param inout 長さsize()の入出力
+     */
+    bool fft(std::span<std::complex<double>> inout)
+    {
+        if (inout.size() != size_)
+            return false;
+
+        FftPolicy::fft(inout.data(), size_, rotors_, workspace_, pool_.get());
+        return true;
+    }
+
+    /**
+     * @brief 連続した周波数ビン[first_bin, first_bin + num_bins)だけを計算するFFT(出力の枝刈り)
+     * @note N = L * P (Lはnum_bins以上の2のべき乗)と分け、
+     *       X_k = 1/P * Σ_p{W_k^p * Y_p(k mod L)}, Y_p = L点FFT{x(p + P*m)}
+     *       とすれば、不要な出力に向かうバタフライを計算せずに済む. 計算量O(N log L + N).
+     * @note ビン番号はsize()を法として扱う. fourier_coef()と同じく1/N化される.
+     * @note 作業領域はL点分だけ、最初の呼び出し(またはLが変わったとき)に確保する. data_, fouriers_は更新しない.
+     * 
+     * @param data 
+     * @param size size()以下
+     * @param first_bin 
+     * @param num_bins size()以下
+     * @param out 長さnum_bins以上の出力先
+     */
+    template <class T>
+    bool fft_range(const T* data, size_t size, size_t first_bin, size_t num_bins, std::span<FourierCoef> out)
+    {
+        if (size > size_ || num_bins > size_ || out.size() < num_bins)
+            return false;
+        if (num_bins == 0)
+            return true;
+
+        size_t L = FftPolicy::calc_size(num_bins);
+        size_t P = size_ / L;
+        prepare_range(L);
+        FourierVector& y = range_decimated_;
+
+        std::fill(std::begin(out), std::begin(out) + num_bins, FourierCoef(0.0, 0.0));
+        for (size_t p = 0; p < P; ++p)
+        {
+            // 間引いた系列 y(m) = x(p + P*m) (範囲外はゼロ埋め)
+            for (size_t m = 0, n = p; m < L; ++m, n += P)
+            {
+                y[m] = FourierCoef(n < size ? (double)data[n] : 0.0, 0.0);
+            }
+            size_t extent = p < size ? (size - p + P - 1) / P : 0; // y(m)のうち元データの長さ
+            FftPolicy::fft(y.data(), L, range_rotors_, range_workspace_, nullptr, extent); // 1/L化される
+
+            // W_k^p を掛けて足し込む
+            size_t k = first_bin % size_;
+            size_t idx_w = (p * k) % size_;
+            for (size_t i = 0; i < num_bins; ++i)
+            {
+                out[i] += rotors_[idx_w] * y[k % L];
+                if (++k == size_)
+                    k = 0;
+                idx_w += p;
+                if (idx_w >= size_)
+                    idx_w -= size_;
+            }
+        }
+
+        // 1/L化されているので、残りの1/Pを掛ける
+        FourierCoef norm(1.0/P, 0.0);
+        std::for_each(std::begin(out), std::begin(out) + num_bins, [&norm](auto& value) {
+            value = value * norm;
+        });
+        return true;
+    }
+
+    /**
+     * @brief 任意の周波数ビンの集合だけを計算するFFT
+     * @note ビンがまばらなときはビンごとにGoertzel(O(size)/ビン)、
+     *       まとまっているときは最小から最大までをfft_rangeで計算して拾う. 計算量の小さい方を選ぶ.
+     * 
+     * @param data 
+     * @param size size()以下
+     * @param bins 0以上size()未満のビン番号
+     * @param out 長さbins.size()以上の出力先
+     */
+    template <class T>
+    bool fft_bins(const T* data, size_t size, std::span<const size_t> bins, std::span<FourierCoef> out)
+    {
+        if (size > size_ || out.size() < bins.size())
+            return false;
+        if (bins.empty())
+            return true;
+
+        auto [min_bin, max_bin] = std::minmax_element(std::begin(bins), std::end(bins));
+        if (*max_bin >= size_)
+            return false;
+
+        size_t num_bins = *max_bin - *min_bin + 1;
+        size_t L = FftPolicy::calc_size(num_bins);
+        size_t n_level = 0;
+        while ((size_t(1) << n_level) < L) { ++n_level; }
+
+        double cost_goertzel = (double)bins.size() * size;
+        double cost_range = (double)size_ * (n_level + 1) + (double)size_ / L * num_bins;
+        if (cost_goertzel <= cost_range)
+        {
+            goertzel(data, size, bins, out);
+            return true;
+        }
+
+        // 拾う区間は前回以下の長さなら確保し直さない
+        FourierVector& range = range_bins_;
+        range.resize(num_bins);
+        if (!fft_range(data, size, *min_bin, num_bins, std::span<FourierCoef>(range.data(), range.size())))
+            return false;
+        for (size_t i = 0; i < bins.size(); ++i)
+        {
+            out[i] = range[bins[i] - *min_bin];
+        }
+        return true;
+    }
+
+    /**
+     * @brief 少数の周波数ビンだけをGoertzelで計算する(トーン検出用)
+     * @note 係数はrotors_から取り、大きな作業領域は確保しない. 計算量O(size * ビン数).
+     * @note 入力は1回の走査でgoertzel_lanes個のビンずつまとめて処理される.
+     * @note fourier_coef()と同じく1/N化される. data_, fouriers_は更新しない.
+     * 
+     * @param data 
+     * @param size size()以下
+     * @param ks ビン番号(size()を法として扱う)
+     * @param out 長さks.size()以上の出力先
+     */
+    template <class T>
+    bool bins(const T* data, size_t size, std::span<const size_t> ks, std::span<FourierCoef> out) const
+    {
+        if (size > size_ || out.size() < ks.size())
+            return false;
+
+        goertzel(data, size, ks, out);
+        return true;
+    }
+
+    /**
+     * @brief 少数の周波数ビンだけをGoertzelで計算する(トーン検出用)
+     * @note fourier.bins(data, size, {k1, k2, ...}) のように使う.
+     * @return ビンごとの複素フーリエ係数. sizeがsize()を超える場合は空.
+     */
+    template <class T>
+    std::vector<FourierCoef> bins(const T* data, size_t size, std::initializer_list<size_t> ks) const
+    {
+        std::vector<size_t> bin_list(ks);
+        std::vector<FourierCoef> out(bin_list.size());
+        if (!bins(data, size, std::span<const size_t>(bin_list), std::span<FourierCoef>(out)))
+            return {};
+        return out;
+    }
+
+    /**
+     * @brief 有意な周波数成分がk個程度の信号から、大きい順にk個の成分を求める(スパースFFT)
+     * @note ラウンドごとにランダムな奇数σで周波数を g = σ*f (mod N) と並べ替え、
+     *       平坦な通過域を持つ窓(長さ約1.3 * B * ln(1/leakage))で、g の上位ビットごとのB個のバケットに振り分ける.
+     *       B点FFTを数回(時間シフトごと)行うだけなので、計算量は O(num_rounds * B * log(N/B) * ln(1/leakage)) でsize()に対して劣線形.
+     * @note バケットに成分が1つだけなら、時間シフトτによる位相の回転 exp{-j*2*pi*g*τ/N} から g を上位ビットから順に決める.
+     *       過半数のラウンドで見つかった周波数を採用し、係数は各ラウンドの推定値の中央値にする.
+     * @note 係数はfourier_coef()と同じく1/N化される. data_, fouriers_は更新しない.
+     * @note Bがsize()に対して大きすぎる場合は通常のFFTから上位k個を選ぶ.
+     * 
+     * @param data 
+     * @param size size()以下
+     * @param k 求める成分の数
+     * @param params 精度と速度の調整
+     * @return (ビン番号, 複素フーリエ係数)の組. 係数の絶対値の大きい順. sizeがsize()を超える場合は空.
+     */
+    template <class T>
+    std::vector<std::pair<size_t, FourierCoef>>
+    sparse_fft(const T* data, size_t size, size_t k, const SparseFftParams& params = {})
+    {
+        std::vector<std::pair<size_t, FourierCoef>> result;
+        if (size > size_ || k == 0)
+            return result;
+
+        const size_t n = size_;
+        const size_t num_buckets = FftPolicy::calc_size(params.num_buckets > 0 ? params.num_buckets
+                                                                               : params.bucket_factor * k);
+        const double log_leakage = -std::log(params.leakage);
+        const double sigma_t = num_buckets * std::sqrt(2.0 * log_leakage) / 3.141592653589793; // 窓のガウス関数の幅
+        const double half_band = 0.5 / num_buckets;                                            // 通過域の片幅(1バケット分)
+        const size_t half_width = (size_t)std::ceil(sigma_t * std::sqrt(2.0 * log_leakage));   // 窓の片側の長さ
+
+        auto by_magnitude = [](const auto& a, const auto& b) { return std::abs(a.second) > std::abs(b.second); };
+
+        if (4 * num_buckets > n || 2 * half_width + 1 > n)
+        {
+            // 疎にする意味がないので通常のFFTで計算する
+            FourierVector dense(n);
+            fft(std::span<const T>(data, size), std::span<FourierCoef>(dense.data(), n));
+            result.reserve(n);
+            for (size_t i = 0; i < n; ++i) { result.emplace_back(i, dense[i]); }
+            size_t top = std::min(k, n);
+            std::partial_sort(std::begin(result), std::begin(result) + top, std::end(result), by_magnitude);
+            result.resize(top);
+            return result;
+        }
+
+        // フィルタの時間窓 G(t), t = -half_width...half_width
+        std::vector<double> filter(2 * half_width + 1);
+        for (size_t i = 0; i < filter.size(); ++i)
+        {
+            double t = (double)i - (double)half_width;
+            double sinc = (i == half_width) ? 2.0 * half_band
+                                            : std::sin(2.0 * 3.141592653589793 * half_band * t) / (3.141592653589793 * t);
+            filter[i] = num_buckets * std::exp(-t * t / (2.0 * sigma_t * sigma_t)) * sinc;
+        }
+
+        // 時間シフト. 0の次はバケットの幅から曖昧さなく決まるB/4から始め、N/2まで伸ばす
+        std::vector<size_t> shifts = {0};
+        for (size_t tau = std::max<size_t>(1, num_buckets / 4); ; tau <<= std::max(1, params.shift_step_bits))
+        {
+            if (tau >= n / 2)
+            {
+                shifts.push_back(n / 2);
+                break;
+            }
+            shifts.push_back(tau);
+        }
+
+        const auto bucket_rotors = FftPolicy::calc_rotors(num_buckets);
+        const auto bucket_workspace = FftPolicy::make_workspace(num_buckets);
+        const size_t mask = n - 1; // nは2のべき乗
+        const size_t num_rounds = std::max<size_t>(1, params.num_rounds);
+
+        std::mt19937_64 rng(params.seed);
+        std::vector<size_t> sigmas(num_rounds);
+        std::vector<FourierVector> buckets(num_rounds * shifts.size(), FourierVector(num_buckets));
+        std::vector<size_t> candidates;
+
+        // 周波数gが入るバケットと、バケットの中心からのずれ(周期/サンプル)
+        auto nearest_bucket = [&](size_t g) -> std::pair<size_t, double> {
+            size_t b = (size_t)std::llround((double)g * num_buckets / n) & (num_buckets - 1);
+            double nu = ((double)b * (n / num_buckets) - (double)g) / n;
+            nu -= std::round(nu);
+            return std::make_pair(b, nu);
+        };
+
+        for (size_t r = 0; r < num_rounds; ++r)
+        {
+            const size_t sigma = (rng() & mask) | 1; // 奇数ならNを法として可逆
+            sigmas[r] = sigma;
+
+            for (size_t s = 0; s < shifts.size(); ++s)
+            {
+                // 窓を掛けてB個に折り畳む: u[t mod B] += G(t) * x(σ*(t + τ))
+                auto& u = buckets[r * shifts.size() + s];
+                std::fill(std::begin(u), std::end(u), FourierCoef(0.0, 0.0));
+                for (size_t i = 0; i < filter.size(); ++i)
+                {
+                    size_t t = (i - half_width + shifts[s]) & mask;
+                    size_t index = (sigma * t) & mask;
+                    if (index < size)
+                        u[(i - half_width) & (num_buckets - 1)] += filter[i] * (double)data[index];
+                }
+                FftPolicy::fft(u.data(), num_buckets, bucket_rotors, bucket_workspace);
+            }
+
+            const auto& z0 = buckets[r * shifts.size()];
+            double max_magnitude = 0.0;
+            for (const auto& z : z0) { max_magnitude = std::max(max_magnitude, std::abs(z)); }
+
+            // σ^-1 (mod 2^64) をニュートン法で求める
+            size_t sigma_inv = sigma;
+            for (int i = 0; i < 6; ++i) { sigma_inv *= 2 - sigma * sigma_inv; }
+
+            for (size_t b = 0; b < num_buckets; ++b)
+            {
+                double magnitude = std::abs(z0[b]);
+                if (magnitude == 0.0 || magnitude < params.relative_threshold * max_magnitude)
+                    continue;
+
+                // 上位ビットから順に g を決める
+                double g_est = (double)b * (n / num_buckets);
+                bool single = true;
+                for (size_t s = 1; s < shifts.size(); ++s)
+                {
+                    auto z = buckets[r * shifts.size() + s][b];
+                    if (std::abs(std::abs(z) - magnitude) > 0.5 * magnitude)
+                    {
+                        single = false; // 成分が衝突している
+                        break;
+                    }
+                    double tau = (double)shifts[s];
+                    double psi = -std::arg(z / z0[b]) / (2.0 * 3.141592653589793);
+                    double m = std::round(g_est * tau / n - psi);
+                    g_est = (psi + m) * n / tau;
+                }
+                if (!single)
+                    continue;
+
+                size_t g = (size_t)(std::llround(g_est)) & mask;
+                if (nearest_bucket(g).first != b)
+                    continue;
+                candidates.push_back((sigma_inv * g) & mask);
+            }
+        }
+
+        // 投票
+        std::sort(std::begin(candidates), std::end(candidates));
+        const size_t min_votes = params.min_votes > 0 ? params.min_votes : num_rounds / 2 + 1;
+        std::vector<double> re(num_rounds);
+        std::vector<double> im(num_rounds);
+        for (size_t i = 0; i < candidates.size();)
+        {
+            size_t j = i;
+            while (j < candidates.size() && candidates[j] == candidates[i]) { ++j; }
+            if (j - i >= min_votes)
+            {
+                // 各ラウンドでのバケットの値をフィルタの応答で割り、中央値をとる
+                size_t f = candidates[i];
+                for (size_t r = 0; r < num_rounds; ++r)
+                {
+                    auto [b, nu] = nearest_bucket((sigmas[r] * f) & mask);
+                    auto value = buckets[r * shifts.size()][b] / sparse_filter_response(nu, half_band, sigma_t);
+                    re[r] = value.real();
+                    im[r] = value.imag();
+                }
+                std::nth_element(std::begin(re), std::begin(re) + num_rounds / 2, std::end(re));
+                std::nth_element(std::begin(im), std::begin(im) + num_rounds / 2, std::end(im));
+                result.emplace_back(f, FourierCoef(re[num_rounds / 2], im[num_rounds / 2]));
+            }
+            i = j;
+        }
+
+        std::sort(std::begin(result), std::end(result), by_magnitude);
+        if (result.size() > k)
+            result.resize(k);
+
+        if (params.refine && !result.empty())
+        {
+            std::vector<size_t> ks(result.size());
+            std::vector<FourierCoef> coefs(result.size());
+            for (size_t i = 0; i < result.size(); ++i) { ks[i] = result[i].first; }
+            goertzel(data, size, std::span<const size_t>(ks), std::span<FourierCoef>(coefs));
+            for (size_t i = 0; i < result.size(); ++i) { result[i].second = coefs[i]; }
+            std::sort(std::begin(result), std::end(result), by_magnitude);
+        }
+        return result;
+    }
+
+    /**
+     * @brief fourier_coef()の逆変換 x(n) = Σ_k{W_k^-n * X_k}
+     * @note fourier_coef()は実数データの係数(エルミート対称)なので、ビン0...N/2からN/2点FFTで戻す.
+     *       fourier_coef()は書き換えない.
+     *
+     * @param data 出力先
+     * @param size size()以下. 先頭size個を書き込む
+     * @return まだfft/dftしていない(またはtake_coefficients()の後)ならfalse
+     */
     template <class T>
     bool ifft(T* data, size_t size)
     {
-        return false;
+        if (size > size_ || !has_coefficients_)
+            return false;
+
+        prepare_real();
+        std::copy(std::begin(fouriers_), std::begin(fouriers_) + size_ / 2 + 1, std::begin(half_));
+        inverse_real(half_.data(), pool_.get(), [&](size_t n, double value) {
+            if (n < size)
+                data[n] = (T)value;
+        });
+        return true;
+    }
+
+    /**
+     * @brief 呼び出し元の複素数データをその場で逆変換するIFFT
+     * @note x(n) = Σ_k{W_k^-n * X_k}. fft(inout)の逆.
+     *
+     * @param inout 長さsize()の入出力
+     */
+    bool ifft(std::span<std::complex<double>> inout)
+    {
+        if (inout.size() != size_)
+            return false;
+
+        FftPolicy::ifft(inout.data(), size_, rotors_, workspace_, pool_.get());
+        return true;
+    }
+
+    /**
+     * @brief 実数入力の変換(rfft/irfftなど)の回転子・作業領域を作る
+     * @note 非const版は必要なら自動で呼ぶ. 複数スレッドから同時に呼ぶconst版の前に一度呼んでおくこと.
+     */
+    void prepare_real()
+    {
+        const size_t m = size_ / 2;
+        if (half_.size() == m + 1)
+            return;
+
+        // N/2点FFTの回転子はN点の回転子を1個おきに取り出したもの
+        half_rotors_.resize(m);
+        for (size_t j = 0; j < m; ++j) { half_rotors_[j] = rotors_[2 * j]; }
+        half_workspace_ = FftPolicy::make_workspace(m);
+        half_.resize(m + 1);
+    }
+
+    /**
+     * @brief 実数データのFFT(N/2点の複素FFTで計算する)
+     * @note 出力はビン0...N/2のN/2+1個. 残りは X_{N-k} = conj(X_k).
+     * @note fourier_coef()と同じく1/N化される. data_, fouriers_は更新しない.
+     *
+     * @param data
+     * @param size size()以下
+     * @param out 長さsize()/2+1以上の出力先
+     */
+    template <class T>
+    bool rfft(const T* data, size_t size, std::span<FourierCoef> out)
+    {
+        if (size > size_ || out.size() < size_ / 2 + 1)
+            return false;
+
+        prepare_real();
+        forward_real(data, size, out.data(), pool_.get());
+        return true;
+    }
+
+    /**
+     * @brief rfftの逆変換(実数データに戻す)
+     *
+     * @param in ビン0...N/2のN/2+1個の係数
+     * @param data 出力先
+     * @param size size()以下. 先頭size個を書き込む
+     */
+    template <class T>
+    bool irfft(std::span<const FourierCoef> in, T* data, size_t size)
+    {
+        if (size > size_ || in.size() < size_ / 2 + 1)
+            return false;
+
+        prepare_real();
+        std::copy(std::begin(in), std::begin(in) + size_ / 2 + 1, std::begin(half_));
+        inverse_real(half_.data(), pool_.get(), [&](size_t n, double value) {
+            if (n < size)
+                data[n] = (T)value;
+        });
+        return true;
+    }
+
+    /**
+     * @brief 作業領域を共有しないrfft(複数スレッドから同時に呼べる)
+     * @note prepare_real()を先に呼んでおくこと. 呼んでいなければfalse.
+     *
+     * @param pool 変換を並列化するスレッドプール(nullptrなら逐次)
+     */
+    template <class T>
+    bool rfft(const T* data, size_t size, std::span<FourierCoef> out, fft::ThreadPool* pool) const
+    {
+        if (size > size_ || out.size() < size_ / 2 + 1 || half_.size() != size_ / 2 + 1)
+            return false;
+
+        forward_real(data, size, out.data(), pool);
+        return true;
+    }
+
+    /**
+     * @brief 作業領域を共有しないirfft(複数スレッドから同時に呼べる)
+     * @note 入力の係数を作業領域として書き換える. prepare_real()を先に呼んでおくこと.
+     *
+     * @param inout ビン0...N/2のN/2+1個の係数(書き換えられる)
+     * @param data 出力先
+     * @param size size()以下. 先頭size個を書き込む
+     * @param pool 変換を並列化するスレッドプール(nullptrなら逐次)
+     */
+    template <class T>
+    bool irfft(std::span<FourierCoef> inout, T* data, size_t size, fft::ThreadPool* pool) const
+    {
+        if (size > size_ || inout.size() < size_ / 2 + 1 || half_.size() != size_ / 2 + 1)
+            return false;
+
+        inverse_real(inout.data(), pool, [&](size_t n, double value) {
+            if (n < size)
+                data[n] = (T)value;
+        });
+        return true;
+    }
+
+    /**
+     * @brief 解析信号 z(n) = x(n) + j*H{x}(n) (ヒルベルト変換)
+     * @note 順変換、半分のスペクトルのマスク、逆変換を1回で行う. どちらもN/2点の複素FFT.
+     *       包絡線は|z(n)|、瞬時位相はarg(z(n)).
+     * @note ゼロ埋めしたsize()点を1周期として扱う(巡回). 長い記録はAnalyticSignalStreamを使う.
+     * @note data_, fouriers_は更新しない.
+     *
+     * @param data
+     * @param size size()以下
+     * @param out 長さsize以上の出力先
+     */
+    template <class T>
+    bool analytic_signal(const T* data, size_t size, std::span<FourierCoef> out)
+    {
+        if (size > size_ || out.size() < size)
+            return false;
+
+        prepare_real();
+        analytic_core(data, size, half_.data(), pool_.get(), out.data());
+        return true;
+    }
+
+    /**
+     * @brief 連続して並んだcount本の長さsizeのデータの解析信号
+     * @note 本数がスレッド数以上なら1本ずつスレッドに割り当てる(スレッドごとの作業領域を確保する).
+     *       少なければ1本ずつ、変換の中で並列化する.
+     *
+     * @param data count * size個
+     * @param size size()以下
+     * @param count
+     * @param out 長さcount * size以上の出力先
+     */
+    template <class T>
+    bool analytic_signal_batch(const T* data, size_t size, size_t count, std::span<FourierCoef> out)
+    {
+        if (size > size_ || out.size() < size * count)
+            return false;
+
+        prepare_real();
+        fft::ThreadPool* pool = pool_.get();
+        if (pool && count >= pool->size())
+        {
+            const size_t chunks = pool->size();
+            std::vector<FourierVector> scratch(chunks, FourierVector(size_ / 2 + 1));
+            pool->parallel_for(0, chunks, 1, [&](size_t first, size_t last) {
+                for (size_t c = first; c < last; ++c)
+                {
+                    for (size_t i = count * c / chunks; i < count * (c + 1) / chunks; ++i)
+                    {
+                        analytic_core(data + i * size, size, scratch[c].data(), nullptr, out.data() + i * size);
+                    }
+                }
+            });
+        }
+        else
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                analytic_core(data + i * size, size, half_.data(), pool, out.data() + i * size);
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief 実ケプストラム c(n) = 1/N * Σ_k{log|X_k| * W_k^-n} (Xは1/N化しない係数)
+     * @note 順変換(N/2点FFT)、対数振幅、逆変換(N/2点FFT)を1つの作業領域で行う.
+     *       対数振幅は平方根をとらずに 0.5 * log(re^2 + im^2) で計算し、実数・偶対称なので実数の逆変換で戻す.
+     * @note ピッチ・エコーの検出で使うのは先頭の低いケフレンシーだけなので、outの長さ分だけ書き込む.
+     * @note data_, fouriers_は更新しない.
+     *
+     * @param data
+     * @param size size()以下
+     * @param out 長さsize()以下の出力先. 先頭out.size()個のケフレンシーを書き込む
+     * @param floor パワー(re^2 + im^2, 1/N化した係数)の下限. log(0)を避ける
+     */
+    template <class T>
+    bool real_cepstrum(const T* data, size_t size, std::span<double> out,
+                       double floor = std::numeric_limits<double>::min())
+    {
+        if (size > size_ || out.size() > size_)
+            return false;
+
+        prepare_real();
+        const size_t m = size_ / 2;
+        const double log_n = std::log((double)size_); // 1/N化を戻す
+        FourierCoef* half = half_.data();
+        forward_real(data, size, half, pool_.get());
+        for (size_t k = 0; k <= m; ++k)
+        {
+            double power = half[k].real() * half[k].real() + half[k].imag() * half[k].imag();
+            half[k] = FourierCoef(0.5 * std::log(std::max(power, floor)) + log_n, 0.0);
+        }
+
+        const double norm = 1.0 / size_;
+        inverse_real(half, pool_.get(), [&](size_t n, double value) {
+            if (n < out.size())
+                out[n] = value * norm;
+        });
+        return true;
+    }
+
+    /**
+     * @brief 複素ケプストラム c(n) = 1/N * Σ_k{log(X_k) * W_k^-n}, log(X_k) = log|X_k| + j*arg(X_k)
+     * @note 位相はビン0...N/2で隣との差を(-pi, pi]に畳んで積算して連続にし(アンラップ)、
+     *       ビンN/2の位相から決まる線形位相 pi * r * k/(N/2) を取り除く. rは入力の巡回的な遅れ(サンプル数)に当たる.
+     * @note アンラップは隣のビンとの位相差がpiより十分小さいことを前提とする. 足りなければゼロ埋めしてsize()を大きくする.
+     * @note 実数データのlog(X_k)はエルミート対称なので、実ケプストラムと同じく実数の逆変換で戻す.
+     *
+     * @param data
+     * @param size size()以下
+     * @param out 長さsize()以下の出力先. 先頭out.size()個のケフレンシーを書き込む
+     * @param delay 取り除いた線形位相に当たる遅れr(不要ならnullptr)
+     * @param floor パワーの下限
+     */
+    template <class T>
+    bool complex_cepstrum(const T* data, size_t size, std::span<double> out, long* delay = nullptr,
+                          double floor = std::numeric_limits<double>::min())
+    {
+        if (size > size_ || out.size() > size_)
+            return false;
+
+        prepare_real();
+        const size_t m = size_ / 2;
+        const double pi = 3.141592653589793;
+        const double log_n = std::log((double)size_);
+        FourierCoef* half = half_.data();
+        forward_real(data, size, half, pool_.get());
+
+        // 対数振幅を実部、アンラップした位相を虚部に入れる
+        double previous = 0.0; // 1つ前のビンの(畳む前の)位相
+        double unwrapped = 0.0;
+        for (size_t k = 0; k <= m; ++k)
+        {
+            double power = half[k].real() * half[k].real() + half[k].imag() * half[k].imag();
+            double phase = std::arg(half[k]);
+            double step = phase - previous;
+            step -= 2 * pi * std::ceil((step - pi) / (2 * pi)); // (-pi, pi]に畳む
+            unwrapped = k == 0 ? phase : unwrapped + step;
+            previous = phase;
+            half[k] = FourierCoef(0.5 * std::log(std::max(power, floor)) + log_n, unwrapped);
+        }
+
+        // 線形位相を取り除く. ビン0とN/2の残りの位相(符号による0かpi)は落とす
+        long r = m > 0 ? std::lround(half[m].imag() / pi) : 0;
+        for (size_t k = 1; k < m; ++k)
+        {
+            half[k] -= FourierCoef(0.0, pi * r * (double)k / m);
+        }
+        half[0] = FourierCoef(half[0].real(), 0.0);
+        half[m] = FourierCoef(half[m].real(), 0.0);
+        if (delay)
+            *delay = r;
+
+        const double norm = 1.0 / size_;
+        inverse_real(half, pool_.get(), [&](size_t n, double value) {
+            if (n < out.size())
+                out[n] = value * norm;
+        });
+        return true;
     }
 
     std::vector<double> amplifiers()
@@ -240,8 +1180,9 @@ class Fourier2D
      * @note Nはサンプリング数
      */
     using Rotor = std::complex<double>;
-    std::vector<Rotor> rotors_width_;
-    std::vector<Rotor> rotors_height_;
+    using RotorVector = typename FftPolicy::RotorVector;
+    RotorVector rotors_width_;
+    RotorVector rotors_height_;
 
     /**
      * @brief 複素フーリエ係数
@@ -249,13 +1190,16 @@ class Fourier2D
      * @note N倍されているので、振幅・位相として使用するときは1/N倍すること.
      */
     using FourierCoef = std::complex<double>;
-    std::vector<FourierCoef> fouriers_; // 2次元[N][M]
+    using FourierVector = fft::FirstTouchVector<FourierCoef>;
+    FourierVector fouriers_; // 2次元[N][M]
 
     /**
      * @brief データ領域 2次元[N][M]
      * @note 元データにゼロ埋めパディングを施したもの
+     * @note fouriers_と同じくFirstTouchVectorで、確保したスレッドではなく行ブロックを担当するスレッドが最初に書き込む.
      */
-    std::vector<double> data_; // 2次元[N][M]
+    using DataVector = fft::FirstTouchVector<double>;
+    DataVector data_; // 2次元[N][M]
 
     /**
      * @brief フーリエ変換で使用する画像の縦横サイズ
@@ -264,8 +1208,21 @@ class Fourier2D
     size_t width_;
     size_t height_;
 
+    /**
+     * @brief 変換の作業領域(ビットリバースのインデックスマップと転置行列)
+     * @note 構築時に一度だけ確保し、fft2dのたびにヒープを確保しない.
+     */
+    typename FftPolicy::Workspace2D workspace_;
+
+    /**
+     * @brief 行・列ごとの変換を並列化するスレッドプール
+     * @note nullptrなら逐次実行. コピーしたオブジェクト間では共有される.
+     */
+    std::shared_ptr<fft::ThreadPool> pool_;
+
 public:
-    Fourier2D(size_t width, size_t height)
+    Fourier2D(size_t width, size_t height, std::shared_ptr<fft::ThreadPool> pool = nullptr)
+        : pool_(std::move(pool))
     {
         // 1. ２次元フーリエ変換に必要な縦横サイズを計算
         auto[width_, height_] = FftPolicy::calc_2d_size(width, height);
@@ -273,12 +1230,26 @@ public:
         this->height_ = height_;
         // std::printf("width_: %lu, height_: %lu\n", width_, height_);
 
-        // 2. 2次元フーリエ係数に必要なメモリサイズを確保する
+        // 2. 2次元フーリエ係数とデータ領域を確保する
+        // 確保時には書き込まず、fft2dと同じ行ブロックの分割でゼロ埋めする.
+        // ページは各行を変換するスレッドのNUMAノードに置かれる(ファーストタッチ).
         fouriers_.resize(width_ * height_);
+        data_.resize(width_ * height_);
+        auto zero_rows = [&](size_t first, size_t last) {
+            std::fill(std::begin(data_) + first * width_, std::begin(data_) + last * width_, (double)0);
+            std::fill(std::begin(fouriers_) + first * width_, std::begin(fouriers_) + last * width_, FourierCoef(0.0, 0.0));
+        };
+        if (pool_)
+            pool_->parallel_for_static(0, height_, zero_rows);
+        else
+            zero_rows(0, height_);
 
         // 3. 回転子の計算
         rotors_width_ = FftPolicy::calc_rotors(width_);
         rotors_height_ = FftPolicy::calc_rotors(height_);
+
+        // 4. 作業領域の確保
+        workspace_ = FftPolicy::make_workspace_2d(width_, height_);
     }
 
     virtual ~Fourier2D() {};
@@ -297,59 +1268,117 @@ public:
         return height_;
     }
 
-    std::vector<Rotor> rotors_width() const
+    void set_thread_pool(std::shared_ptr<fft::ThreadPool> pool)
+    {
+        pool_ = std::move(pool);
+    }
+
+    std::shared_ptr<fft::ThreadPool> thread_pool() const
+    {
+        return pool_;
+    }
+
+    const RotorVector& rotors_width() const
     {
         return rotors_width_;
     }
 
-    std::vector<Rotor> rotors_height() const
+    const RotorVector& rotors_height() const
     {
         return rotors_height_;
     }
 
-    std::vector<double> zero_padding_data_2d() const
+    const DataVector& zero_padding_data_2d() const
     {
         return data_;
     }
 
-    std::vector<FourierCoef> fourier_coef_2d() const
+    const FourierVector& fourier_coef_2d() const
     {
         return fouriers_;
     }
 
+    /**
+     * @brief 2次元複素フーリエ係数のビュー(コピーしない)
+     * @note 行優先[height()][width()]. (x, y)の係数は view[y * width() + x].
+     * @note 次のfft2d/shift_fft2dで内容が書き換わる. take_coefficients_2d()の後は空になる.
+     */
+    std::span<const FourierCoef> fourier_coef_2d_view() const
+    {
+        return std::span<const FourierCoef>(fouriers_.data(), fouriers_.size());
+    }
+
+    std::span<const Rotor> rotors_width_view() const
+    {
+        return std::span<const Rotor>(rotors_width_.data(), rotors_width_.size());
+    }
+
+    std::span<const Rotor> rotors_height_view() const
+    {
+        return std::span<const Rotor>(rotors_height_.data(), rotors_height_.size());
+    }
+
+    std::span<const double> zero_padding_data_2d_view() const
+    {
+        return std::span<const double>(data_.data(), data_.size());
+    }
+
+    /**
+     * @brief 2次元複素フーリエ係数をムーブで取り出す
+     * @note 取り出した後のfourier_coef_2d()は空. 次のfft2dで再確保される.
+     */
+    FourierVector take_coefficients_2d()
+    {
+        return std::move(fouriers_);
+    }
+
     template <class T>
     bool fft2d(const T* data, size_t width, size_t height)
     {
         if (width > width_ || height > height_)
             return false;
-        std::printf("width_: %lu, height_: %lu\n", width_, height_);
         
-        // ゼロ埋めデータ作成
+        // ゼロ埋めデータ作成と複素フーリエ係数の準備
+        // 構築時のゼロ埋めと同じ行ブロックの分割で、並列に書き込む.
+        // take_coefficients_2d()の後に確保し直した場合は、ここで各行が変換するスレッドのNUMAノードに置かれる(ファーストタッチ).
         data_.resize(width_ * height_);
-        std::fill(std::begin(data_), std::end(data_), (double)0);
-        size_t i = 0;
-        const T* j = data;
-        auto k = std::begin(data_);
-        for (;
-             i < height; 
-             ++i, j += width, k += width_)
-        {
-            // 元画像を埋め込む(範囲外はゼロ埋めされてる)
-            std::copy(j, j + width, k);
-        }
-
-        // 複素フーリエ係数の準備
         fouriers_.resize(data_.size()); // N倍されて出力される
-        for (size_t i = 0; i < fouriers_.size(); ++i)
-        {
-            fouriers_[i] = std::complex<double>(data_[i], 0.0); // 虚部なしの複素数
-            // std::printf("fouriers[%zu]: R:%f, I%f\n", i, fouriers[i].real(), fouriers[i].imag());
-        }
+        auto init_rows = [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i)
+            {
+                auto k = std::begin(data_) + i * width_;
+                if (i < height)
+                {
+                    // 元画像を埋め込む(範囲外はゼロ埋め)
+                    const T* j = data + i * width;
+                    std::copy(j, j + width, k);
+                    std::fill(k + width, k + width_, (double)0);
+                }
+                else
+                {
+                    std::fill(k, k + width_, (double)0);
+                }
+
+                auto f = std::begin(fouriers_) + i * width_;
+                for (size_t x = 0; x < width_; ++x)
+                {
+                    f[x] = std::complex<double>(k[x], 0.0); // 虚部なしの複素数
+                }
+            }
+        };
+        if (pool_)
+            pool_->parallel_for_static(0, height_, init_rows);
+        else
+            init_rows(0, height_);
 
         // ポリシーが受け持つ独自アルゴリズムに任せる
-        FftPolicy::fft2d(fouriers_, 
+        FftPolicy::fft2d(fouriers_.data(), 
                          rotors_width_, 
-                         rotors_height_);
+                         rotors_height_,
+                         workspace_,
+                         pool_.get(),
+                         width,
+                         height);
         return true;
     }
 
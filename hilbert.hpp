@@ -0,0 +1,147 @@
+#pragma once
+
+#include "fourier.hpp"
+
+#include <complex>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <span>
+#include <cmath>
+
+
+/**
+ * @brief 長い記録の解析信号を、ブロックごとにオーバーラップ・セーブで求める
+ * @note Fourier::analytic_signalは1フレームを1周期として扱うので、フレームの端で誤差が出る.
+ *       ここでは長さ2D+1のヒルベルト変換FIR h(D+m) = 2/(pi*m) (mが奇数, Blackman窓)を
+ *       FFTで畳み込むので、ブロックの継ぎ目のない連続した出力になる.
+ * @note 1ブロックはN = calc_size(block_size + 2D)点の実数FFT(N/2点の複素FFT)で処理する.
+ *       フィルタのスペクトルは構築時に一度だけ計算し、ブロックごとにはヒープを確保しない.
+ * @note 出力はDサンプル遅れる: z(n) = x(n-D) + j*H{x}(n-D)
+ * @note 帯域の両端(直流付近・ナイキスト付近)はFIRの遷移帯になる. Dを大きくすると遷移帯が狭くなる.
+ */
+template <class FftPolicy>
+class AnalyticSignalStream
+{
+    using FourierCoef = std::complex<double>;
+    using FourierVector = typename FftPolicy::FourierVector;
+    using DataVector = fft::BufferVector<double>;
+
+    Fourier<FftPolicy> fourier_;
+
+    size_t block_size_;
+    size_t half_taps_; // D
+
+    /**
+     * @brief ヒルベルト変換FIRのスペクトル(ビン0...N/2). 畳み込みのN倍を含む
+     */
+    FourierVector filter_;
+
+    /**
+     * @brief 作業領域
+     */
+    DataVector frame_;         // 直近N個のサンプル(先頭が最も古い)
+    DataVector hilbert_;       // フレームとFIRの巡回畳み込み
+    FourierVector spectrum_;   // フレームのスペクトル(ビン0...N/2)
+
+public:
+    /**
+     * @brief Construct a new Analytic Signal Stream object
+     *
+     * @param block_size 1回のprocessで受け取るサンプル数
+     * @param half_taps FIRの片側の長さD(遅延). 1以上
+     * @param pool ブロックのFFTを並列化するスレッドプール
+     */
+    AnalyticSignalStream(size_t block_size,
+                         size_t half_taps = 64,
+                         std::shared_ptr<fft::ThreadPool> pool = nullptr)
+        : fourier_(FftPolicy::calc_size(block_size + 2 * std::max<size_t>(1, half_taps)), std::move(pool))
+        , block_size_(block_size)
+        , half_taps_(std::max<size_t>(1, half_taps))
+    {
+        const size_t n = fourier_.size();
+        const size_t taps = 2 * half_taps_ + 1;
+        frame_.assign(n, 0.0);
+        hilbert_.resize(n);
+        spectrum_.resize(n / 2 + 1);
+        filter_.resize(n / 2 + 1);
+
+        // h(i) = 2/(pi*m) * Blackman(i) (m = i - D が奇数), 0 (偶数)
+        std::vector<double> taps_value(taps, 0.0);
+        for (size_t i = 0; i < taps; ++i)
+        {
+            long m = (long)i - (long)half_taps_;
+            if (m % 2 == 0)
+                continue;
+            double t = 2 * 3.141592653589793 * i / (taps - 1);
+            double window = 0.42 - 0.5 * std::cos(t) + 0.08 * std::cos(2 * t);
+            taps_value[i] = 2.0 / (3.141592653589793 * m) * window;
+        }
+        fourier_.rfft(taps_value.data(), taps, std::span<FourierCoef>(filter_.data(), filter_.size()));
+
+        // 係数は1/N化されているので、巡回畳み込み a ⊛ b のスペクトルは N * A_k * B_k
+        for (auto& value : filter_) { value *= (double)n; }
+    }
+
+    virtual ~AnalyticSignalStream() {};
+    AnalyticSignalStream(const AnalyticSignalStream&) = default;
+    AnalyticSignalStream& operator=(const AnalyticSignalStream&) = default;
+    AnalyticSignalStream(AnalyticSignalStream&&) = default;
+    AnalyticSignalStream& operator=(AnalyticSignalStream&&) = default;
+
+    size_t block_size() const
+    {
+        return block_size_;
+    }
+
+    /*出力の遅れ(サンプル数)*/
+    size_t delay() const
+    {
+        return half_taps_;
+    }
+
+    /*1ブロックのFFTの長さ*/
+    size_t fft_size() const
+    {
+        return fourier_.size();
+    }
+
+    /**
+     * @brief 過去のサンプルを消す(無音から始める)
+     */
+    void reset()
+    {
+        std::fill(std::begin(frame_), std::end(frame_), 0.0);
+    }
+
+    /**
+     * @brief 1ブロック分の解析信号
+     *
+     * @param data block_size()個の新しいサンプル
+     * @param out 長さblock_size()以上の出力先. Dサンプル前の入力に対応する
+     */
+    template <class T>
+    bool process(const T* data, std::span<FourierCoef> out)
+    {
+        if (out.size() < block_size_)
+            return false;
+
+        // オーバーラップ・セーブ: 直近N-B個を前に寄せ、新しいB個を後ろに置く
+        const size_t n = fourier_.size();
+        const size_t keep = n - block_size_;
+        std::copy(std::begin(frame_) + block_size_, std::end(frame_), std::begin(frame_));
+        for (size_t i = 0; i < block_size_; ++i) { frame_[keep + i] = (double)data[i]; }
+
+        std::span<FourierCoef> spectrum(spectrum_.data(), spectrum_.size());
+        fourier_.rfft(frame_.data(), n, spectrum);
+        for (size_t k = 0; k < spectrum_.size(); ++k) { spectrum_[k] *= filter_[k]; }
+        fourier_.irfft(std::span<const FourierCoef>(spectrum), hilbert_.data(), n);
+
+        // 巡回畳み込みのうち、添字2D以上は線形畳み込みと一致する(keep >= 2D)
+        for (size_t i = 0; i < block_size_; ++i)
+        {
+            out[i] = FourierCoef(frame_[keep + i - half_taps_], hilbert_[keep + i]);
+        }
+        return true;
+    }
+};
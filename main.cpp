@@ -42,7 +42,7 @@ int main(int, char**)
     plt::show();
 
     Fourier<fft::CooleyTurkey> fourier(N);
-    auto rotors = fourier.rotors();
+    [[maybe_unused]] const auto& rotors = fourier.rotors();
     // std::for_each(std::begin(rotors), std::end(rotors), [] (auto value) {
     //     std::cout << "rotor: " << value << std::endl;
     // });
@@ -63,7 +63,7 @@ int main(int, char**)
     // std::bindを使うよりもラムダ式で直接オブジェクト変数をキャプチャしたほうが早いし、安全!
     std::function<bool(double*, size_t)> dft_bind = [&](auto data, auto n) { return fourier.dft(data, n); }; 
     invoke_tm_chrono(dft_bind, data, N);
-    auto fourier_coef = fourier.fourier_coef();
+    auto fourier_coef = fourier.fourier_coef_view(); // コピーしない
     std::for_each(std::begin(fourier_coef), std::begin(fourier_coef) + 8, [] (auto value) {
         std::cout << "Amp: " << std::abs(value) << ", Angle: " << std::arg(value) << std::endl;
     });
@@ -77,7 +77,7 @@ int main(int, char**)
     // std::bindを使うよりもラムダ式で直接オブジェクト変数をキャプチャしたほうが早いし、安全!
     std::function<bool(double*, size_t)> fft_bind = [&](auto data, auto n) { return fourier.fft(data, n); };
     invoke_tm_chrono(fft_bind, data, N);
-    fourier_coef = fourier.fourier_coef();
+    fourier_coef = fourier.fourier_coef_view();
     std::for_each(std::begin(fourier_coef), std::begin(fourier_coef) + 8, [] (auto value) {
         std::cout << "Amp: " << std::abs(value) << ", Angle: " << std::arg(value) << std::endl;
     });
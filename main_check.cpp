@@ -0,0 +1,787 @@
+#include "fourier.hpp"
+#include "sliding_fourier.hpp"
+#include "chirp_z.hpp"
+#include "ntt_policy.hpp"
+#include "dd_policy.hpp"
+#include "nufft.hpp"
+#include "dct.hpp"
+#include "mdct.hpp"
+#include "fht_policy.hpp"
+#include "walsh_hadamard.hpp"
+#include "hilbert.hpp"
+#include "convolver.hpp"
+#include "correlator.hpp"
+
+#include <iostream>
+#include <vector>
+#include <complex>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <random>
+#include <span>
+#include <bit>
+
+/**
+ * @brief 各エンジンを愚直な計算(Fourier::dftまたは定義どおりの和)と比べる検証用プログラム
+ * @note 1つでも許容誤差を超えれば終了コード1を返す.
+ */
+
+using Complex = std::complex<double>;
+using Policy = fft::CooleyTurkey;
+
+const double pi = 3.141592653589793;
+
+int failures = 0;
+
+auto check = [](const char* name, double error, double tolerance = 1e-9) {
+    bool ok = error <= tolerance;
+    std::cout << (ok ? "[ OK ] " : "[ NG ] ") << name << ": error=" << error << std::endl;
+    if (!ok)
+        ++failures;
+};
+
+/*X_k = 1/N * Σ_n{x(n) * exp{+j*2*pi*k*n/N}} (ライブラリの規約). ゼロ埋めせずsize点で計算する*/
+auto direct_dft = [](const std::vector<double>& x) {
+    size_t n = x.size();
+    std::vector<Complex> coefs(n);
+    for (size_t k = 0; k < n; ++k)
+    {
+        Complex sum(0.0, 0.0);
+        for (size_t i = 0; i < n; ++i) { sum += x[i] * std::polar(1.0, 2 * pi * ((k * i) % n) / n); }
+        coefs[k] = sum / (double)n;
+    }
+    return coefs;
+};
+
+/*y(n) = Σ_m{h(m) * x(n-m)}*/
+auto direct_convolution = [](const std::vector<double>& x, const std::vector<double>& h) {
+    std::vector<double> y(x.size() + h.size() - 1, 0.0);
+    for (size_t i = 0; i < x.size(); ++i)
+    {
+        for (size_t m = 0; m < h.size(); ++m) { y[i + m] += h[m] * x[i]; }
+    }
+    return y;
+};
+
+template <class A, class B>
+double max_error(const A& a, const B& b, size_t n)
+{
+    double error = 0.0;
+    for (size_t i = 0; i < n; ++i) { error = std::max(error, (double)std::abs(a[i] - b[i])); }
+    return error;
+}
+
+/*再現できる疑似乱数の信号*/
+std::vector<double> make_signal(size_t size, unsigned int seed)
+{
+    std::mt19937 engine(seed);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    std::vector<double> x(size);
+    for (auto& value : x) { value = dist(engine); }
+    return x;
+}
+
+
+void check_fourier(std::shared_ptr<fft::ThreadPool> pool)
+{
+    const size_t N = 256;
+
+    // ifftは係数がなければ失敗する
+    Fourier<Policy> fresh(N, pool);
+    std::vector<double> y(N);
+    check("Fourier::ifft without coefficients", fresh.ifft(y.data(), y.size()) ? 1.0 : 0.0, 0.0);
+
+    // fftの前の係数はゼロ
+    check("Fourier::fourier_coef before fft", max_error(fresh.fourier_coef(), std::vector<Complex>(N), N), 0.0);
+
+    auto x = make_signal(N, 1);
+    Fourier<Policy> fourier(N, pool);
+    Fourier<Policy> reference(N);
+    reference.dft(x.data(), x.size());
+    const auto& expected = reference.fourier_coef();
+    fourier.fft(x.data(), x.size());
+    double error = max_error(fourier.fourier_coef(), expected, N);
+    check("Fourier::fft vs dft", error);
+
+    // 作業領域を使い回しても前の変換の影響は残らない
+    auto other = make_signal(N, 2);
+    fourier.fft(other.data(), other.size());
+    fourier.fft(x.data(), x.size());
+    check("Fourier::fft (reused workspace) vs dft", max_error(fourier.fourier_coef(), expected, N));
+
+    auto misalignment = [](const auto* pointer) { return (double)(reinterpret_cast<std::uintptr_t>(pointer) % 64); };
+    check("Fourier buffers are 64-byte aligned",
+          misalignment(fourier.fourier_coef().data()) + misalignment(fourier.zero_padding_data().data()), 0.0);
+
+    std::vector<double> z(N);
+    fourier.ifft(z.data(), z.size());
+    check("Fourier::ifft round trip", max_error(x, z, N));
+
+    std::vector<Complex> half(N / 2 + 1);
+    fourier.rfft(x.data(), x.size(), std::span<Complex>(half));
+    check("Fourier::rfft vs dft", max_error(half, expected, half.size()));
+    fourier.irfft(std::span<const Complex>(half), z.data(), z.size());
+    check("Fourier::irfft round trip", max_error(x, z, N));
+
+    // 呼び出し元のメモリに出力する
+    std::vector<Complex> out(N);
+    fourier.fft(std::span<const double>(x), std::span<Complex>(out));
+    error = max_error(out, expected, N);
+    std::vector<Complex> inout(x.begin(), x.end());
+    fourier.fft(std::span<Complex>(inout));
+    error = std::max(error, max_error(inout, expected, N));
+    check("Fourier::fft (span) vs dft", error);
+
+    std::vector<Complex> range(20);
+    fourier.fft_range(x.data(), x.size(), 250, range.size(), std::span<Complex>(range));
+    error = 0.0;
+    for (size_t i = 0; i < range.size(); ++i) { error = std::max(error, std::abs(range[i] - expected[(250 + i) % N])); }
+    check("Fourier::fft_range vs dft", error);
+
+    // 長さの違う範囲を続けて求めても、使い回す計画は作り直される
+    std::vector<Complex> wide(70);
+    fourier.fft_range(x.data(), x.size(), 30, wide.size(), std::span<Complex>(wide));
+    fourier.fft_range(x.data(), x.size(), 250, range.size(), std::span<Complex>(range));
+    error = 0.0;
+    for (size_t i = 0; i < wide.size(); ++i) { error = std::max(error, std::abs(wide[i] - expected[30 + i])); }
+    for (size_t i = 0; i < range.size(); ++i) { error = std::max(error, std::abs(range[i] - expected[(250 + i) % N])); }
+    check("Fourier::fft_range (different lengths) vs dft", error);
+
+    std::vector<size_t> ks = {3, 17, 18, 40, 100, 255};
+    std::vector<Complex> picked(ks.size());
+    fourier.fft_bins(x.data(), x.size(), std::span<const size_t>(ks), std::span<Complex>(picked));
+    error = 0.0;
+    for (size_t i = 0; i < ks.size(); ++i) { error = std::max(error, std::abs(picked[i] - expected[ks[i]])); }
+    check("Fourier::fft_bins vs dft", error);
+
+    std::vector<Complex> tones(ks.size());
+    fourier.bins(x.data(), x.size(), std::span<const size_t>(ks), std::span<Complex>(tones));
+    error = 0.0;
+    for (size_t i = 0; i < ks.size(); ++i) { error = std::max(error, std::abs(tones[i] - expected[ks[i]])); }
+    check("Fourier::bins vs dft", error);
+
+    // 整数周期のトーンの解析信号は cos -> sin
+    std::vector<double> tone(N);
+    std::vector<double> quadrature(N);
+    for (size_t n = 0; n < N; ++n)
+    {
+        tone[n] = std::cos(2 * pi * 5 * n / N) + 0.5 * std::cos(2 * pi * 12 * n / N + 0.3);
+        quadrature[n] = std::sin(2 * pi * 5 * n / N) + 0.5 * std::sin(2 * pi * 12 * n / N + 0.3);
+    }
+    std::vector<Complex> analytic(N);
+    fourier.analytic_signal(tone.data(), N, std::span<Complex>(analytic));
+    error = 0.0;
+    for (size_t n = 0; n < N; ++n) { error = std::max(error, std::abs(analytic[n] - Complex(tone[n], quadrature[n]))); }
+    check("Fourier::analytic_signal", error);
+
+    // 本数がスレッド数以上なら1本ずつスレッドに割り当てる. どちらの分け方でも1本ずつの結果と一致する
+    for (size_t count : {2, 12})
+    {
+        auto signals = make_signal(N * count, 3);
+        std::vector<Complex> batch(N * count);
+        fourier.analytic_signal_batch(signals.data(), N, count, std::span<Complex>(batch));
+        error = 0.0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            fourier.analytic_signal(signals.data() + i * N, N, std::span<Complex>(analytic));
+            error = std::max(error, max_error(batch.data() + i * N, analytic, N));
+        }
+        check(count == 2 ? "Fourier::analytic_signal_batch (2 signals) vs analytic_signal"
+                         : "Fourier::analytic_signal_batch (12 signals) vs analytic_signal",
+              error);
+    }
+
+    // x = δ(n) - a*δ(n-1) のケプストラム: 複素は -a^n/n, 実はその偶部 -a^n/(2n)
+    const double a = 0.5;
+    std::vector<double> echo(N, 0.0);
+    echo[0] = 1.0;
+    echo[1] = -a;
+    std::vector<double> real_cep(32);
+    std::vector<double> complex_cep(32);
+    long delay = -1;
+    fourier.real_cepstrum(echo.data(), N, std::span<double>(real_cep));
+    fourier.complex_cepstrum(echo.data(), N, std::span<double>(complex_cep), &delay);
+    error = std::abs(real_cep[0]) + std::abs(complex_cep[0]) + std::abs((double)delay);
+    for (size_t n = 1; n < real_cep.size(); ++n)
+    {
+        error = std::max(error, std::abs(real_cep[n] + std::pow(a, n) / (2.0 * n)));
+        error = std::max(error, std::abs(complex_cep[n] + std::pow(a, n) / n));
+    }
+    check("Fourier::real_cepstrum / complex_cepstrum", error);
+
+    // 先頭の200点だけを渡すと残りはゼロ埋めとして扱い、その分のバタフライを省く
+    Fourier<Policy> padded(N);
+    padded.dft(x.data(), 200);
+    fourier.fft(x.data(), 200);
+    check("Fourier::fft (pruned input) vs dft", max_error(fourier.fourier_coef(), padded.fourier_coef(), N));
+
+    // ビューと取り出しは係数をコピーしない
+    fourier.fft(x.data(), x.size());
+    error = fourier.fourier_coef_view().data() == fourier.fourier_coef().data() ? 0.0 : 1.0;
+    auto taken = fourier.take_coefficients();
+    error = std::max(error, max_error(taken, expected, N));
+    check("Fourier::fourier_coef_view / take_coefficients", error);
+}
+
+void check_thread_pool(std::shared_ptr<fft::ThreadPool> pool)
+{
+    // 入れ子のparallel_forでも各要素を1回ずつ処理する
+    std::vector<int> visits(1000, 0);
+    pool->parallel_for(0, 10, 1, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i)
+        {
+            pool->parallel_for(i * 100, (i + 1) * 100, 8, [&](size_t inner_first, size_t inner_last) {
+                for (size_t j = inner_first; j < inner_last; ++j) { ++visits[j]; }
+            });
+        }
+    });
+    double error = 0.0;
+    for (int count : visits) { error = std::max(error, (double)std::abs(count - 1)); }
+    check("ThreadPool::parallel_for (nested) visits each index once", error, 0.0);
+
+    // 大きさの異なる変換をまとめて投入する
+    std::vector<std::function<double()>> batch;
+    for (size_t n : {16, 1024, 64, 4096})
+    {
+        batch.push_back([n, pool] {
+            auto x = make_signal(n, (unsigned int)n);
+            Fourier<Policy> fourier(n, pool);
+            Fourier<Policy> reference(n);
+            fourier.fft(x.data(), n);
+            reference.dft(x.data(), n);
+            return max_error(fourier.fourier_coef(), reference.fourier_coef(), n);
+        });
+    }
+    error = 0.0;
+    for (auto& future : pool->submit(std::move(batch))) { error = std::max(error, future.get()); }
+    check("ThreadPool::submit (batch of FFTs) vs dft", error);
+
+    // parallel_for_staticは各要素を1回ずつ処理し、先頭の区間は呼び出し元が担当する.
+    // 担当のワーカーが塞がっていればその区間は他のスレッドに回るので、ワーカーとの対応は確かめない
+    std::vector<int> static_visits(100, 0);
+    std::vector<std::thread::id> owners(100);
+    pool->parallel_for_static(0, owners.size(), [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i)
+        {
+            ++static_visits[i];
+            owners[i] = std::this_thread::get_id();
+        }
+    });
+    error = 0.0;
+    for (int count : static_visits) { error = std::max(error, (double)std::abs(count - 1)); }
+    for (size_t i = 0; i < owners.size() / pool->size(); ++i)
+    {
+        error = std::max(error, owners[i] == std::this_thread::get_id() ? 0.0 : 1.0);
+    }
+    check("ThreadPool::parallel_for_static visits each index once", error, 0.0);
+}
+
+void check_fourier_2d(std::shared_ptr<fft::ThreadPool> pool)
+{
+    // 縦横は大きい方の2のべき乗にそろえられる(32x32). 下の8行はゼロ埋め
+    const size_t W = 32;
+    const size_t H = 24;
+    const size_t N = 32;
+    auto image = make_signal(W * H, 4);
+    Fourier2D<Policy> fourier(W, H, pool);
+    // 構築直後の係数はゼロ
+    check("Fourier2D::fourier_coef_2d before fft2d", max_error(fourier.fourier_coef_2d(), std::vector<Complex>(N * N), N * N), 0.0);
+
+    // 作業領域を使い回しても前の変換の影響は残らない
+    auto other = make_signal(W * H, 5);
+    fourier.fft2d(other.data(), W, H);
+    fourier.fft2d(image.data(), W, H);
+    const auto& coefs = fourier.fourier_coef_2d();
+
+    double error = coefs.size() == N * N ? 0.0 : 1.0;
+    for (size_t l = 0; l < N && error < 1.0; ++l)
+    {
+        for (size_t k = 0; k < N; ++k)
+        {
+            Complex sum(0.0, 0.0);
+            for (size_t r = 0; r < H; ++r)
+            {
+                for (size_t c = 0; c < W; ++c)
+                {
+                    sum += image[r * W + c] * std::polar(1.0, 2 * pi * ((k * c + l * r) % N) / N);
+                }
+            }
+            error = std::max(error, std::abs(coefs[l * N + k] - sum / (double)(N * N)));
+        }
+    }
+    check("Fourier2D::fft2d vs direct sum", error);
+}
+
+void check_sparse_fft(std::shared_ptr<fft::ThreadPool> pool)
+{
+    // 3つのトーンだけの信号
+    const size_t M = 4096;
+    Fourier<Policy> sparse(M, pool);
+    std::vector<double> sparse_signal(M);
+    for (size_t n = 0; n < M; ++n)
+    {
+        sparse_signal[n] = 3.0 * std::cos(2 * pi * 100 * n / M) + 2.0 * std::cos(2 * pi * 777 * n / M) + std::cos(2 * pi * 1500 * n / M);
+    }
+    auto found = sparse.sparse_fft(sparse_signal.data(), M, 6);
+    sparse.fft(sparse_signal.data(), M);
+    double error = found.size() == 6 ? 0.0 : 1.0;
+    for (const auto& [k, coef] : found) { error = std::max(error, std::abs(coef - sparse.fourier_coef()[k])); }
+    check("Fourier::sparse_fft vs fft", error, 1e-6);
+}
+
+void check_sliding_fourier()
+{
+    const size_t N = 64;
+    auto x = make_signal(300, 6);
+    std::vector<double> window(x.end() - N, x.end());
+    auto expected = direct_dft(window);
+
+    SlidingFourier<Policy> sliding(N, 0);
+    sliding.update(x.data(), x.size());
+    check("SlidingFourier (all bins) vs direct dft", max_error(sliding.spectrum(), expected, N));
+
+    std::vector<size_t> ks = {1, 7, 30};
+    SlidingFourier<Policy> tracked(N, 50, ks);
+    tracked.update(x.data(), x.size());
+    double error = 0.0;
+    for (size_t k : ks) { error = std::max(error, std::abs(tracked.coef(k) - expected[k])); }
+    check("SlidingFourier (tracked bins, reanchor) vs direct dft", error);
+}
+
+void check_chirp_z()
+{
+    const size_t N = 100;
+    const size_t M = 40;
+    const double first_bin = 3.25;
+    const double bin_step = 0.1;
+    auto x = make_signal(N, 7);
+    ChirpZ<Policy> czt(N, M, first_bin, bin_step);
+    auto coefs = czt.transform(x.data(), N);
+
+    double error = 0.0;
+    for (size_t m = 0; m < M; ++m)
+    {
+        Complex sum(0.0, 0.0);
+        double f = first_bin + m * bin_step;
+        for (size_t n = 0; n < N; ++n) { sum += x[n] * std::polar(1.0, 2 * pi * f * n / N); }
+        error = std::max(error, std::abs(coefs[m] - sum / (double)N));
+    }
+    check("ChirpZ vs direct sum", error);
+}
+
+void check_number_theoretic()
+{
+    std::mt19937 engine(8);
+    std::uniform_int_distribution<std::int32_t> dist(-1000000, 1000000);
+    std::vector<std::int32_t> a(300);
+    std::vector<std::int32_t> b(77);
+    for (auto& value : a) { value = dist(engine); }
+    for (auto& value : b) { value = dist(engine); }
+
+    auto product = fft::NumberTheoretic::convolve(std::span<const std::int32_t>(a), std::span<const std::int32_t>(b));
+    std::vector<std::int64_t> expected(a.size() + b.size() - 1, 0);
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        for (size_t j = 0; j < b.size(); ++j) { expected[i + j] += (std::int64_t)a[i] * b[j]; }
+    }
+    double error = product.size() == expected.size() ? 0.0 : 1.0;
+    for (size_t i = 0; i < std::min(product.size(), expected.size()); ++i)
+    {
+        error = std::max(error, (double)(product[i] != expected[i]));
+    }
+    check("NumberTheoretic::convolve (exact)", error, 0.0);
+}
+
+void check_double_double()
+{
+    const size_t N = 1024;
+    auto x = make_signal(N, 9);
+    Fourier<Policy> fourier(N);
+    fourier.fft(x.data(), N);
+    auto reference = fft::DoubleDouble::reference_fft(x.data(), N);
+    auto [max_abs, rms] = fft::DoubleDouble::compare(fourier.fourier_coef_view(),
+                                                      std::span<const fft::DDComplex>(reference.data(), reference.size()));
+    check("DoubleDouble::reference_fft vs CooleyTurkey", max_abs, 1e-14);
+    check("DoubleDouble relative rms", rms, 1e-14);
+}
+
+void check_nufft(std::shared_ptr<fft::ThreadPool> pool)
+{
+    const size_t N = 64;
+    const size_t count = 200;
+    auto positions = make_signal(count, 10);
+    auto strengths = make_signal(count, 11);
+    for (auto& t : positions) { t = (t + 1.0) * 0.5 * N; }
+
+    // FFTの順のモード番号
+    auto mode = [](size_t i, size_t n) { return i < n / 2 ? (double)i : (double)i - (double)n; };
+
+    NonUniformFourier<Policy> nufft(N, 1e-12, pool);
+    std::vector<Complex> modes(N);
+    nufft.type1(positions.data(), strengths.data(), count, std::span<Complex>(modes));
+    double error = 0.0;
+    for (size_t i = 0; i < N; ++i)
+    {
+        Complex sum(0.0, 0.0);
+        for (size_t j = 0; j < count; ++j) { sum += strengths[j] * std::polar(1.0, 2 * pi * mode(i, N) * positions[j] / N); }
+        error = std::max(error, std::abs(modes[i] - sum / (double)N));
+    }
+    check("NonUniformFourier::type1 vs direct sum", error);
+
+    std::vector<Complex> values(count);
+    nufft.type2(std::span<const Complex>(modes), positions.data(), count, std::span<Complex>(values));
+    error = 0.0;
+    for (size_t j = 0; j < count; ++j)
+    {
+        Complex sum(0.0, 0.0);
+        for (size_t i = 0; i < N; ++i) { sum += modes[i] * std::polar(1.0, -2 * pi * mode(i, N) * positions[j] / N); }
+        error = std::max(error, std::abs(values[j] - sum));
+    }
+    check("NonUniformFourier::type2 vs direct sum", error);
+
+    const size_t W = 16;
+    const size_t H = 8;
+    auto ys = make_signal(count, 12);
+    auto xs = positions;
+    for (auto& t : xs) { t *= (double)W / N; }
+    for (auto& t : ys) { t = (t + 1.0) * 0.5 * H; }
+    NonUniformFourier2D<Policy> nufft2d(W, H, 1e-12, pool);
+    std::vector<Complex> modes2d(W * H);
+    nufft2d.type1(xs.data(), ys.data(), strengths.data(), count, std::span<Complex>(modes2d));
+    error = 0.0;
+    for (size_t l = 0; l < H; ++l)
+    {
+        for (size_t k = 0; k < W; ++k)
+        {
+            Complex sum(0.0, 0.0);
+            for (size_t j = 0; j < count; ++j)
+            {
+                sum += strengths[j] * std::polar(1.0, 2 * pi * (mode(k, W) * xs[j] / W + mode(l, H) * ys[j] / H));
+            }
+            error = std::max(error, std::abs(modes2d[l * W + k] - sum / (double)(W * H)));
+        }
+    }
+    check("NonUniformFourier2D::type1 vs direct sum", error);
+
+    nufft2d.type2(std::span<const Complex>(modes2d), xs.data(), ys.data(), count, std::span<Complex>(values));
+    error = 0.0;
+    for (size_t j = 0; j < count; ++j)
+    {
+        Complex sum(0.0, 0.0);
+        for (size_t l = 0; l < H; ++l)
+        {
+            for (size_t k = 0; k < W; ++k)
+            {
+                sum += modes2d[l * W + k] * std::polar(1.0, -2 * pi * (mode(k, W) * xs[j] / W + mode(l, H) * ys[j] / H));
+            }
+        }
+        error = std::max(error, std::abs(values[j] - sum));
+    }
+    check("NonUniformFourier2D::type2 vs direct sum", error);
+}
+
+void check_dct(std::shared_ptr<fft::ThreadPool> pool)
+{
+    const size_t N = 64;
+    auto x = make_signal(N, 13);
+    auto direct = [](const std::vector<double>& v, size_t k) {
+        size_t n = v.size();
+        double sum = 0.0;
+        for (size_t i = 0; i < n; ++i) { sum += v[i] * std::cos(pi * (2 * i + 1) * k / (2.0 * n)); }
+        return sum * std::sqrt((k == 0 ? 1.0 : 2.0) / n);
+    };
+
+    CosineTransform<Policy> dct(N, pool);
+    auto y = x;
+    dct.dct2(y.data(), N);
+    double error = 0.0;
+    for (size_t k = 0; k < N; ++k) { error = std::max(error, std::abs(y[k] - direct(x, k))); }
+    check("CosineTransform::dct2 vs direct sum", error);
+    dct.dct3(y.data(), N);
+    check("CosineTransform::dct3 round trip", max_error(x, y, N));
+
+    const size_t W = 16;
+    const size_t H = 8;
+    auto image = make_signal(W * H, 14);
+    CosineTransform2D<Policy> dct2d(W, H, pool);
+    auto coefs = image;
+    dct2d.dct2_2d(coefs.data(), W, H);
+    error = 0.0;
+    for (size_t l = 0; l < H; ++l)
+    {
+        for (size_t k = 0; k < W; ++k)
+        {
+            double sum = 0.0;
+            for (size_t r = 0; r < H; ++r)
+            {
+                for (size_t c = 0; c < W; ++c)
+                {
+                    sum += image[r * W + c] * std::cos(pi * (2 * c + 1) * k / (2.0 * W)) * std::cos(pi * (2 * r + 1) * l / (2.0 * H));
+                }
+            }
+            sum *= std::sqrt((k == 0 ? 1.0 : 2.0) / W) * std::sqrt((l == 0 ? 1.0 : 2.0) / H);
+            error = std::max(error, std::abs(coefs[l * W + k] - sum));
+        }
+    }
+    check("CosineTransform2D::dct2_2d vs direct sum", error);
+    dct2d.dct3_2d(coefs.data(), W, H);
+    check("CosineTransform2D::dct3_2d round trip", max_error(image, coefs, W * H));
+}
+
+void check_mdct()
+{
+    const size_t M = 32;
+    auto x = make_signal(2 * M, 15);
+    ModifiedCosineTransform<Policy> mdct(M, MdctWindow::KaiserBessel);
+    auto window = mdct.window_view();
+    std::vector<double> coefs(M);
+    mdct.forward(x.data(), std::span<double>(coefs));
+    double error = 0.0;
+    for (size_t k = 0; k < M; ++k)
+    {
+        double sum = 0.0;
+        for (size_t n = 0; n < 2 * M; ++n) { sum += window[n] * x[n] * std::cos(pi / M * (n + 0.5 + M / 2.0) * (k + 0.5)); }
+        error = std::max(error, std::abs(coefs[k] - sum));
+    }
+    check("ModifiedCosineTransform::forward vs direct sum", error);
+
+    // 50%重ねて合成すると、Mサンプル遅れて元に戻る(TDAC)
+    const size_t frames = 8;
+    auto signal = make_signal(frames * M, 16);
+    std::vector<double> output(frames * M);
+    ModifiedCosineTransform<Policy> stream(M);
+    for (size_t f = 0; f < frames; ++f)
+    {
+        stream.analyze(signal.data() + f * M, std::span<double>(coefs));
+        stream.synthesize(std::span<const double>(coefs), output.data() + f * M);
+    }
+    check("ModifiedCosineTransform analyze/synthesize (TDAC)", max_error(signal, output.data() + M, (frames - 1) * M));
+}
+
+void check_hartley()
+{
+    const size_t N = 128;
+    auto x = make_signal(N, 17);
+    auto rotors = fft::Hartley::calc_rotors(N);
+    auto workspace = fft::Hartley::make_workspace(N);
+    fft::Hartley::DataVector h(x.begin(), x.end());
+    fft::Hartley::fht(h.data(), N, rotors, workspace);
+    double error = 0.0;
+    for (size_t k = 0; k < N; ++k)
+    {
+        double sum = 0.0;
+        for (size_t n = 0; n < N; ++n)
+        {
+            double t = 2 * pi * ((k * n) % N) / N;
+            sum += x[n] * (std::cos(t) + std::sin(t));
+        }
+        error = std::max(error, std::abs(h[k] - sum / N));
+    }
+    check("Hartley::fht vs direct sum", error);
+    fft::Hartley::ifht(h.data(), N, rotors, workspace);
+    check("Hartley::ifht round trip", max_error(x, h, N));
+
+    auto a = make_signal(100, 18);
+    auto b = make_signal(33, 19);
+    std::vector<double> out(a.size() + b.size() - 1);
+    fft::Hartley::convolve(std::span<const double>(a), std::span<const double>(b), std::span<double>(out));
+    check("Hartley::convolve vs direct sum", max_error(out, direct_convolution(a, b), out.size()));
+}
+
+void check_walsh_hadamard(std::shared_ptr<fft::ThreadPool> pool)
+{
+    const size_t N = 256;
+    std::mt19937 engine(20);
+    std::uniform_int_distribution<std::int32_t> dist(-1000, 1000);
+    std::vector<std::int32_t> x(N);
+    for (auto& value : x) { value = dist(engine); }
+
+    auto y = x;
+    fft::WalshHadamard::wht(y.data(), N, pool.get());
+    double error = 0.0;
+    for (size_t k = 0; k < N; ++k)
+    {
+        std::int64_t sum = 0;
+        for (size_t n = 0; n < N; ++n) { sum += (std::popcount(k & n) % 2 ? -1 : 1) * x[n]; }
+        error = std::max(error, (double)std::abs(sum - y[k]));
+    }
+    fft::WalshHadamard::iwht(y.data(), N, pool.get());
+    error = std::max(error, max_error(x, y, N));
+    check("WalshHadamard::wht/iwht (int32, exact)", error, 0.0);
+
+    // 本数がスレッド数以上なら1本ずつスレッドに割り当てる
+    const size_t count = 2 * pool->size();
+    std::vector<std::int32_t> signals(N * count);
+    for (auto& value : signals) { value = dist(engine); }
+    auto batch = signals;
+    fft::WalshHadamard::wht_batch(batch.data(), N, count, pool.get());
+    error = 0.0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        y.assign(signals.begin() + i * N, signals.begin() + (i + 1) * N);
+        fft::WalshHadamard::wht(y.data(), N);
+        error = std::max(error, max_error(batch.data() + i * N, y, N));
+    }
+    fft::WalshHadamard::iwht_batch(batch.data(), N, count, pool.get());
+    error = std::max(error, max_error(signals, batch, N * count));
+    check("WalshHadamard::wht_batch/iwht_batch (int32, exact)", error, 0.0);
+
+    const size_t W = 16;
+    const size_t H = 8;
+    auto image = make_signal(W * H, 21);
+    auto coefs = image;
+    fft::WalshHadamard::wht2d(coefs.data(), W, H, pool.get());
+    error = 0.0;
+    for (size_t l = 0; l < H; ++l)
+    {
+        for (size_t k = 0; k < W; ++k)
+        {
+            double sum = 0.0;
+            for (size_t r = 0; r < H; ++r)
+            {
+                for (size_t c = 0; c < W; ++c)
+                {
+                    sum += ((std::popcount(l & r) + std::popcount(k & c)) % 2 ? -1.0 : 1.0) * image[r * W + c];
+                }
+            }
+            error = std::max(error, std::abs(coefs[l * W + k] - sum));
+        }
+    }
+    check("WalshHadamard::wht2d vs direct sum", error);
+}
+
+void check_analytic_stream()
+{
+    // 帯域の中央のトーンは遷移帯から遠いので、FIRでもほぼ理想的な90度移相になる
+    const size_t B = 100;
+    const size_t D = 64;
+    const size_t blocks = 10;
+    const double f = 0.13;
+    AnalyticSignalStream<Policy> stream(B, D);
+    std::vector<double> x(B * blocks);
+    for (size_t n = 0; n < x.size(); ++n) { x[n] = std::cos(2 * pi * f * n); }
+    std::vector<Complex> z(B * blocks);
+    for (size_t i = 0; i < blocks; ++i)
+    {
+        stream.process(x.data() + i * B, std::span<Complex>(z.data() + i * B, B));
+    }
+
+    double error = 0.0;
+    for (size_t n = 2 * D; n < z.size(); ++n)
+    {
+        double t = 2 * pi * f * (double)(n - D);
+        error = std::max(error, std::abs(z[n] - Complex(std::cos(t), std::sin(t))));
+    }
+    check("AnalyticSignalStream vs ideal quadrature", error, 1e-3);
+}
+
+void check_convolver(std::shared_ptr<fft::ThreadPool> pool)
+{
+    auto h = make_signal(300, 22);
+    auto x = make_signal(5000, 23);
+    auto expected = direct_convolution(x, h);
+
+    for (auto method : {ConvolutionMethod::OverlapSave, ConvolutionMethod::OverlapAdd})
+    {
+        Convolver<Policy> convolver(h.data(), h.size(), 128, method, pool);
+        std::vector<double> y(x.size() / 128 * 128);
+        for (size_t i = 0; i + 128 <= x.size(); i += 128) { convolver.process(x.data() + i, y.data() + i); }
+        check(method == ConvolutionMethod::OverlapSave ? "Convolver::process (overlap-save) vs direct sum"
+                                                       : "Convolver::process (overlap-add) vs direct sum",
+              max_error(y, expected, y.size()));
+    }
+
+    Convolver<Policy> offline(h.data(), h.size(), 0, ConvolutionMethod::OverlapSave, pool);
+    std::vector<double> y(expected.size());
+    offline.convolve(x.data(), x.size(), std::span<double>(y));
+    check("Convolver::convolve vs direct sum", max_error(y, expected, y.size()));
+
+    PartitionedConvolver<Policy> partitioned(h.data(), h.size(), 64, pool);
+    std::vector<double> z(x.size() / 64 * 64);
+    for (size_t i = 0; i + 64 <= x.size(); i += 64) { partitioned.process(x.data() + i, z.data() + i); }
+    check("PartitionedConvolver::process vs direct sum", max_error(z, expected, z.size()));
+}
+
+void check_correlator(std::shared_ptr<fft::ThreadPool> pool)
+{
+    auto r = make_signal(50, 24);
+    auto x = make_signal(400, 25);
+    for (size_t n = 0; n < r.size(); ++n) { x[120 + n] += 4.0 * r[n]; }
+
+    Correlator<Policy> correlator(r.data(), r.size(), x.size(), pool);
+    std::vector<double> c(correlator.output_size(x.size()));
+    correlator.xcorr(x.data(), x.size(), std::span<double>(c));
+    double error = 0.0;
+    for (size_t i = 0; i < c.size(); ++i)
+    {
+        long lag = (long)i - (long)(r.size() - 1);
+        double sum = 0.0;
+        for (size_t n = 0; n < r.size(); ++n)
+        {
+            long m = (long)n + lag;
+            if (m >= 0 && m < (long)x.size())
+                sum += x[m] * r[n];
+        }
+        error = std::max(error, std::abs(c[i] - sum));
+    }
+    check("Correlator::xcorr vs direct sum", error);
+    check("Correlator::peak_lag", std::abs(correlator.peak_lag(std::span<const double>(c), false) - 120.0), 0.0);
+
+    // 本数がスレッド数以上なら1本ずつスレッドに割り当てる
+    const size_t count = 2 * pool->size();
+    const size_t S = 300;
+    const size_t length = correlator.output_size(S);
+    auto signals = make_signal(S * count, 26);
+    std::vector<double> batch(length * count);
+    std::vector<double> single(length);
+    correlator.xcorr_batch(signals.data(), S, count, std::span<double>(batch));
+    error = 0.0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        correlator.xcorr(signals.data() + i * S, S, std::span<double>(single));
+        error = std::max(error, max_error(batch.data() + i * length, single, length));
+    }
+    check("Correlator::xcorr_batch vs xcorr", error);
+
+    std::vector<double> a(x.size());
+    correlator.autocorrelation(x.data(), x.size(), std::span<double>(a));
+    error = 0.0;
+    for (size_t l = 0; l < x.size(); ++l)
+    {
+        double sum = 0.0;
+        for (size_t n = 0; n + l < x.size(); ++n) { sum += x[n + l] * x[n]; }
+        error = std::max(error, std::abs(a[l] - sum));
+    }
+    check("Correlator::autocorrelation vs direct sum", error);
+}
+
+
+int main(int, char**)
+{
+    std::cout << "Check Fourier engines against direct sums\n";
+
+    auto pool = std::make_shared<fft::ThreadPool>(4);
+    check_fourier(nullptr);
+    check_fourier(pool);
+    check_thread_pool(pool);
+    check_fourier_2d(pool);
+    check_sparse_fft(pool);
+    check_sliding_fourier();
+    check_chirp_z();
+    check_number_theoretic();
+    check_double_double();
+    check_nufft(pool);
+    check_dct(pool);
+    check_mdct();
+    check_hartley();
+    check_walsh_hadamard(pool);
+    check_analytic_stream();
+    check_convolver(pool);
+    check_correlator(pool);
+
+    std::cout << (failures == 0 ? "All checks passed" : "Some checks failed") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,297 @@
+#pragma once
+
+#include "fft_policy.hpp"
+
+#include <complex>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <span>
+#include <cmath>
+
+
+/**
+ * @brief MDCTの窓関数
+ * @note どちらもPrincen-Bradley条件 w(n)^2 + w(n+M)^2 = 1 を満たし、50%重ねて窓を2回掛けると元に戻る(TDAC).
+ */
+enum class MdctWindow
+{
+    Sine,            // w(n) = sin{pi*(n+1/2)/(2M)}
+    KaiserBessel,    // KBD窓(Kaiser窓の累積和の平方根). 阻止域の減衰が大きい
+};
+
+
+/**
+ * @brief MDCT/IMDCT
+ * @note 係数の数M(2のべき乗)、窓の長さ2M、フレームの間隔M(50%重なり).
+ * @note MDCT:  X_k = Σ_{n=0}^{2M-1}{w(n) * x(n) * cos{pi/M * (n + 1/2 + M/2) * (k + 1/2)}}
+ * @note IMDCT: y(n) = w(n) * 2/M * Σ_{k=0}^{M-1}{X_k * cos{pi/M * (n + 1/2 + M/2) * (k + 1/2)}}
+ *       隣り合うフレームのyを重ねて足すと、入力がMサンプル遅れて復元される.
+ * @note 2M点の入力をM点に折り畳んでDCT-IVにし、DCT-IVはM/2点の複素FFTと前後の回転で計算する(窓の長さの1/4点のFFT).
+ * @note 窓・回転・作業領域はすべて構築時に確保し、フレームごとの処理ではヒープを確保しない.
+ */
+template <class FftPolicy>
+class ModifiedCosineTransform
+{
+    using FourierCoef = std::complex<double>;
+    using FourierVector = typename FftPolicy::FourierVector;
+    using DataVector = fft::BufferVector<double>;
+
+    size_t size_;      // 係数の数M
+    size_t fft_size_;  // M/2
+
+    DataVector window_;        // 長さ2M
+    FourierVector pre_twiddles_;  // exp{+j*pi*(4n+1)/(4M)}
+    FourierVector post_twiddles_; // exp{+j*pi*k/M}
+
+    typename FftPolicy::RotorVector rotors_;
+    typename FftPolicy::Workspace workspace_;
+
+    DataVector frame_;     // 窓を掛けた2M点のフレーム
+    DataVector folded_;    // 折り畳んだM点
+    FourierVector scratch_;
+
+    /**
+     * @brief ストリーミングの状態
+     */
+    DataVector history_;   // MDCT: 直前のMサンプル
+    DataVector overlap_;   // IMDCT: 直前のフレームの後半(窓を掛けたもの)
+
+    std::shared_ptr<fft::ThreadPool> pool_;
+
+    static double bessel_i0(double x)
+    {
+        // 0次の第1種変形ベッセル関数 Σ{(x/2)^(2k) / (k!)^2}
+        double sum = 1.0;
+        double term = 1.0;
+        for (int k = 1; k < 200; ++k)
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+            if (term < sum * 1e-17)
+                break;
+        }
+        return sum;
+    }
+
+    void make_window(MdctWindow type, double alpha)
+    {
+        const size_t m = size_;
+        window_.resize(2 * m);
+        if (type == MdctWindow::Sine)
+        {
+            for (size_t n = 0; n < 2 * m; ++n)
+            {
+                window_[n] = std::sin(3.141592653589793 * (n + 0.5) / (2 * m));
+            }
+            return;
+        }
+
+        // KBD: w(n) = sqrt{Σ_{j<=n}K(j) / Σ_{j<=M}K(j)}, Kは長さM+1のKaiser窓
+        std::vector<double> cumulative(m + 1);
+        double sum = 0.0;
+        for (size_t j = 0; j <= m; ++j)
+        {
+            double r = 2.0 * j / m - 1.0;
+            sum += bessel_i0(3.141592653589793 * alpha * std::sqrt(std::max(0.0, 1.0 - r * r)));
+            cumulative[j] = sum;
+        }
+        for (size_t n = 0; n < m; ++n)
+        {
+            window_[n] = std::sqrt(cumulative[n] / sum);
+            window_[2 * m - 1 - n] = window_[n];
+        }
+    }
+
+    /**
+     * @brief DCT-IV: Y_k = Σ_m{u(m) * cos{pi*(2m+1)*(2k+1)/(4M)}} (その場で変換)
+     * @note v(n) = u(2n) + j*u(M-1-2n) に前の回転を掛けてM/2点FFTし、後の回転を掛けると
+     *       d_k = Σ_n{v(n) * exp{-j*pi*(4n+1)*(4k+1)/(4M)}} になり、Y_2k = Re(d_k), Y_{M-1-2k} = -Im(d_k).
+     *       このライブラリのFFTは指数が正なので、共役をとって計算する.
+     */
+    void dct4(double* u)
+    {
+        const size_t m = size_;
+        const size_t half = fft_size_;
+        for (size_t n = 0; n < half; ++n)
+        {
+            scratch_[n] = FourierCoef(u[2 * n], -u[m - 1 - 2 * n]) * pre_twiddles_[n];
+        }
+        FftPolicy::fft(scratch_.data(), half, rotors_, workspace_, pool_.get());
+        for (size_t k = 0; k < half; ++k)
+        {
+            FourierCoef d = post_twiddles_[k] * scratch_[k] * (double)half; // conj(d_k)
+            u[2 * k] = d.real();
+            u[m - 1 - 2 * k] = d.imag();
+        }
+    }
+
+public:
+    /**
+     * @brief Construct a new Modified Cosine Transform object
+     *
+     * @param size 係数の数M(フレームの間隔). 2のべき乗に切り上げられる. 2以上
+     * @param window 窓関数
+     * @param kbd_alpha KBD窓のパラメータ(AACでは長いブロックで4)
+     * @param pool 内部のFFTを並列化するスレッドプール
+     */
+    ModifiedCosineTransform(size_t size,
+                            MdctWindow window = MdctWindow::Sine,
+                            double kbd_alpha = 4.0,
+                            std::shared_ptr<fft::ThreadPool> pool = nullptr)
+        : pool_(std::move(pool))
+    {
+        size_ = std::max<size_t>(2, FftPolicy::calc_size(size));
+        fft_size_ = size_ / 2;
+        make_window(window, kbd_alpha);
+
+        pre_twiddles_.resize(fft_size_);
+        post_twiddles_.resize(fft_size_);
+        for (size_t n = 0; n < fft_size_; ++n)
+        {
+            pre_twiddles_[n] = std::polar(1.0, 3.141592653589793 * (4.0 * n + 1.0) / (4.0 * size_));
+            post_twiddles_[n] = std::polar(1.0, 3.141592653589793 * n / size_);
+        }
+
+        rotors_ = FftPolicy::calc_rotors(fft_size_);
+        workspace_ = FftPolicy::make_workspace(fft_size_);
+        frame_.resize(2 * size_);
+        folded_.resize(size_);
+        scratch_.resize(fft_size_);
+        history_.assign(size_, 0.0);
+        overlap_.assign(size_, 0.0);
+    }
+
+    virtual ~ModifiedCosineTransform() {};
+    ModifiedCosineTransform(const ModifiedCosineTransform&) = default;
+    ModifiedCosineTransform& operator=(const ModifiedCosineTransform&) = default;
+    ModifiedCosineTransform(ModifiedCosineTransform&&) = default;
+    ModifiedCosineTransform& operator=(ModifiedCosineTransform&&) = default;
+
+    /*係数の数(フレームの間隔)*/
+    size_t size() const
+    {
+        return size_;
+    }
+
+    /*窓の長さ*/
+    size_t frame_size() const
+    {
+        return 2 * size_;
+    }
+
+    std::span<const double> window_view() const
+    {
+        return std::span<const double>(window_.data(), window_.size());
+    }
+
+    /**
+     * @brief ストリーミングの状態を消す
+     */
+    void reset()
+    {
+        std::fill(std::begin(history_), std::end(history_), 0.0);
+        std::fill(std::begin(overlap_), std::end(overlap_), 0.0);
+    }
+
+    /**
+     * @brief 1フレームのMDCT(窓を掛ける)
+     * @param frame 長さ2Mの入力
+     * @param coefs 長さMの出力
+     */
+    template <class T>
+    bool forward(const T* frame, std::span<double> coefs)
+    {
+        if (coefs.size() < size_)
+            return false;
+
+        // u(m) = -x(3M/2-1-m) - x(3M/2+m)  (m < M/2)
+        // u(m) =  x(m-M/2)   - x(3M/2-1-m) (m >= M/2)
+        const size_t m = size_;
+        const size_t h = m / 2;
+        for (size_t i = 0; i < h; ++i)
+        {
+            folded_[i] = -window_[3 * h - 1 - i] * frame[3 * h - 1 - i] - window_[3 * h + i] * frame[3 * h + i];
+        }
+        for (size_t i = h; i < m; ++i)
+        {
+            folded_[i] = window_[i - h] * frame[i - h] - window_[3 * h - 1 - i] * frame[3 * h - 1 - i];
+        }
+        dct4(folded_.data());
+        std::copy(std::begin(folded_), std::end(folded_), std::begin(coefs));
+        return true;
+    }
+
+    /**
+     * @brief 1フレームのIMDCT(窓を掛ける. 重ねて足すのは呼び出し元)
+     * @param coefs 長さMの係数
+     * @param frame 長さ2Mの出力
+     */
+    template <class T>
+    bool inverse(std::span<const double> coefs, T* frame)
+    {
+        if (coefs.size() < size_)
+            return false;
+
+        const size_t m = size_;
+        const size_t h = m / 2;
+        std::copy(std::begin(coefs), std::begin(coefs) + m, std::begin(folded_));
+        dct4(folded_.data());
+
+        // 折り畳みの転置: y(n) = u(n+M/2), -u(3M/2-1-n), -u(n-3M/2)
+        const double scale = 2.0 / m;
+        for (size_t n = 0; n < 2 * m; ++n)
+        {
+            double y;
+            if (n < h)
+                y = folded_[n + h];
+            else if (n < 3 * h)
+                y = -folded_[3 * h - 1 - n];
+            else
+                y = -folded_[n - 3 * h];
+            frame[n] = (T)(window_[n] * y * scale);
+        }
+        return true;
+    }
+
+    /**
+     * @brief ストリーミングのMDCT
+     * @note 直前のMサンプルと今回のMサンプルで1フレームを作る.
+     * @param samples 新しいMサンプル
+     * @param coefs 長さMの出力
+     */
+    template <class T>
+    bool analyze(const T* samples, std::span<double> coefs)
+    {
+        if (coefs.size() < size_)
+            return false;
+
+        std::copy(std::begin(history_), std::end(history_), std::begin(frame_));
+        for (size_t i = 0; i < size_; ++i)
+        {
+            frame_[size_ + i] = (double)samples[i];
+            history_[i] = (double)samples[i];
+        }
+        return forward(frame_.data(), coefs);
+    }
+
+    /**
+     * @brief ストリーミングのIMDCT(重ね合わせの状態を内部に持つ)
+     * @note analyzeと組にすると、入力がMサンプル遅れて出てくる.
+     * @param coefs 長さMの係数
+     * @param samples Mサンプルの出力
+     */
+    template <class T>
+    bool synthesize(std::span<const double> coefs, T* samples)
+    {
+        if (!inverse(coefs, frame_.data()))
+            return false;
+
+        for (size_t i = 0; i < size_; ++i)
+        {
+            samples[i] = (T)(overlap_[i] + frame_[i]);
+            overlap_[i] = frame_[size_ + i];
+        }
+        return true;
+    }
+};
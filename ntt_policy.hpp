@@ -0,0 +1,592 @@
+#pragma once
+
+#include "fft_policy.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <span>
+#include <type_traits>
+
+
+namespace fft
+{
+    /**
+     * @brief 奇素数Modulus(< 2^31)を法とするMontgomery乗算
+     * @note R = 2^32. 乗算は a*b*R^-1 (mod p) を除算なしで計算する.
+     * @note 片方だけをMontgomery表現(x*R)にしておけば、mulの結果は通常の剰余になる.
+     *       回転子をMontgomery表現で持ち、データは通常の剰余のまま変換する.
+     */
+    template <std::uint32_t Modulus, std::uint32_t PrimitiveRoot>
+    struct Montgomery
+    {
+        static_assert(Modulus % 2 == 1 && Modulus < (std::uint32_t(1) << 31), "Modulus must be an odd prime below 2^31");
+
+        static constexpr std::uint32_t modulus = Modulus;
+        static constexpr std::uint32_t primitive_root = PrimitiveRoot;
+
+        /*-p^-1 (mod 2^32). ニュートン法で1回ごとに正しいビット数が倍になる*/
+        static constexpr std::uint32_t neg_inv = [] {
+            std::uint32_t x = Modulus;
+            for (int i = 0; i < 5; ++i) { x *= 2 - Modulus * x; }
+            return 0u - x;
+        }();
+
+        /*R^2 (mod p)*/
+        static constexpr std::uint32_t r2 = [] {
+            std::uint64_t r = (std::uint64_t(1) << 32) % Modulus;
+            return std::uint32_t(r * r % Modulus);
+        }();
+
+        /*p-1を割り切る最大の2のべき乗(変換できる最大の長さ)*/
+        static constexpr std::size_t max_size = [] {
+            std::size_t size = 1;
+            while ((Modulus - 1) % (size * 2) == 0) { size *= 2; }
+            return size;
+        }();
+
+        static constexpr std::uint32_t reduce(std::uint64_t t)
+        {
+            std::uint32_t m = std::uint32_t(t) * neg_inv;
+            std::uint32_t u = std::uint32_t((t + std::uint64_t(m) * Modulus) >> 32); // t < p^2, m*p < 2^32*p なので64bitに収まる
+            return u >= Modulus ? u - Modulus : u;
+        }
+
+        static constexpr std::uint32_t mul(std::uint32_t a, std::uint32_t b)
+        {
+            return reduce(std::uint64_t(a) * b);
+        }
+
+        static constexpr std::uint32_t add(std::uint32_t a, std::uint32_t b)
+        {
+            std::uint32_t s = a + b;
+            return s >= Modulus ? s - Modulus : s;
+        }
+
+        static constexpr std::uint32_t sub(std::uint32_t a, std::uint32_t b)
+        {
+            return a >= b ? a - b : a + Modulus - b;
+        }
+
+        /*通常の剰余 -> Montgomery表現*/
+        static constexpr std::uint32_t to(std::uint32_t a)
+        {
+            return mul(a, r2);
+        }
+
+        /*Montgomery表現 -> 通常の剰余*/
+        static constexpr std::uint32_t from(std::uint32_t a)
+        {
+            return reduce(a);
+        }
+
+        /*Montgomery表現のべき乗*/
+        static constexpr std::uint32_t pow(std::uint32_t a, std::uint64_t e)
+        {
+            std::uint32_t result = to(1);
+            for (; e > 0; e >>= 1, a = mul(a, a))
+            {
+                if (e & 1)
+                    result = mul(result, a);
+            }
+            return result;
+        }
+
+        /*通常の剰余の逆元(通常の剰余で返す)*/
+        static constexpr std::uint32_t inverse(std::uint32_t a)
+        {
+            return from(pow(to(a), Modulus - 2));
+        }
+
+        /*整数をpを法とする剰余にする*/
+        template <class T>
+        static constexpr std::uint32_t residue(T value)
+        {
+            if constexpr (std::is_signed_v<T>)
+            {
+                if (value < 0)
+                {
+                    std::uint32_t r = std::uint32_t((std::uint64_t(0) - std::uint64_t(std::int64_t(value))) % Modulus);
+                    return r == 0 ? 0 : Modulus - r;
+                }
+            }
+            return std::uint32_t(std::uint64_t(value) % Modulus);
+        }
+    };
+
+    /*NTTに使う素数 p = c * 2^k + 1 と原始根*/
+    using NttPrime1 = Montgomery<469762049, 3>;   // 7 * 2^26 + 1
+    using NttPrime2 = Montgomery<1811939329, 13>; // 27 * 2^26 + 1
+    using NttPrime3 = Montgomery<2013265921, 31>; // 15 * 2^27 + 1
+
+    /**
+     * @brief 数論変換(NTT)のポリシー
+     * @note CooleyTurkeyと同じ周波数間引き型のバタフライとビットリバースの作業領域を使い、
+     *       複素数の回転子の代わりに1の原始N乗根 ω = g^((p-1)/N) (mod p) を使う.
+     * @note 順変換 X_k = Σ_n{ω^(kn) * x(n)}, 逆変換 x(n) = 1/N * Σ_k{ω^(-kn) * X_k}.
+     *       整数の畳み込みを正確に求めるため、CooleyTurkeyと違い1/Nは逆変換側で掛ける.
+     * @note データは通常の剰余[0, p), 回転子はMontgomery表現.
+     */
+    template <class Field>
+    class NumberTheoreticTransform
+    {
+    public:
+        static constexpr size_t parallel_grain = CooleyTurkey::parallel_grain;
+        static constexpr size_t full_extent = CooleyTurkey::full_extent;
+        static constexpr size_t max_size = Field::max_size;
+
+        /*まとめて計算するブロックの要素数(32KB)*/
+        static constexpr size_t cache_block = 1 << 13;
+
+        using FourierVector = BufferVector<std::uint32_t>;
+        using RotorVector = BufferVector<std::uint32_t>;
+        using Workspace = CooleyTurkey::Workspace;
+
+    private:
+        /**
+         * @brief 1レベル分のバタフライ演算のうち、通し番号[first, last)の区間を計算する
+         * @note 入力の枝刈りはCooleyTurkey::butterflyと同じ.
+         * @param rotors このレベルの回転子 ω_{2*half_size}^k (k = 0...half_size-1). 連続して並んでいる
+         * @note Inverse = trueのときは ω^-k = -ω^(half_size-k) を使う.
+         */
+        template <bool Inverse>
+        static void butterfly(std::uint32_t* fouriers,
+                              const std::uint32_t* rotors,
+                              size_t half_size,
+                              size_t first,
+                              size_t last,
+                              size_t extent)
+        {
+            size_t nonzero = std::min(extent, 2 * half_size);
+            size_t full_end = nonzero > half_size ? nonzero - half_size : 0; // k < full_end: f1, f2ともに非ゼロ
+            size_t half_end = std::min(nonzero, half_size);                  // k < half_end: f1だけ非ゼロ
+
+            auto rotor = [&](size_t index) -> std::uint32_t {
+                if constexpr (Inverse)
+                    return index == 0 ? rotors[0] : Field::modulus - rotors[half_size - index];
+                else
+                    return rotors[index];
+            };
+
+            size_t j = first / half_size;
+            size_t k = first % half_size;
+            for (size_t b = first; b < last; ++j, k = 0)
+            {
+                size_t butterfly_offset = 2 * half_size * j;
+                size_t k_end = std::min(half_size, k + (last - b));
+                b += k_end - k;
+                for (; k < std::min(k_end, full_end); ++k)
+                {
+                    size_t j1 = butterfly_offset + k;
+                    size_t j2 = j1 + half_size;
+                    auto f1 = fouriers[j1];
+                    auto f2 = fouriers[j2];
+                    fouriers[j1] = Field::add(f1, f2);
+                    fouriers[j2] = Field::mul(rotor(k), Field::sub(f1, f2));
+                }
+                for (; k < std::min(k_end, half_end); ++k)
+                {
+                    size_t j1 = butterfly_offset + k;
+                    fouriers[j1 + half_size] = Field::mul(rotor(k), fouriers[j1]);
+                }
+                k = k_end;
+            }
+        }
+
+        /**
+         * @brief 時間間引き型のバタフライ演算(逆変換用). 通し番号[first, last)の区間を計算する
+         * @note ビットリバース順の入力から自然な順の出力を作るので、周波数間引き型の順変換と組み合わせると並べ替えがいらない.
+         */
+        static void butterfly_dit(std::uint32_t* fouriers,
+                                  const std::uint32_t* rotors,
+                                  size_t half_size,
+                                  size_t first,
+                                  size_t last)
+        {
+            size_t j = first / half_size;
+            size_t k = first % half_size;
+            for (size_t b = first; b < last; ++j, k = 0)
+            {
+                size_t butterfly_offset = 2 * half_size * j;
+                size_t k_end = std::min(half_size, k + (last - b));
+                b += k_end - k;
+                for (; k < k_end; ++k)
+                {
+                    size_t j1 = butterfly_offset + k;
+                    size_t j2 = j1 + half_size;
+                    std::uint32_t rotor = k == 0 ? rotors[0] : Field::modulus - rotors[half_size - k]; // ω^-k
+                    auto f1 = fouriers[j1];
+                    auto f2 = Field::mul(rotor, fouriers[j2]);
+                    fouriers[j1] = Field::add(f1, f2);
+                    fouriers[j2] = Field::sub(f1, f2);
+                }
+            }
+        }
+
+        template <class Func>
+        static void dispatch(ThreadPool* pool, size_t begin, size_t end, Func&& func, size_t grain = parallel_grain)
+        {
+            if (pool)
+                pool->parallel_for(begin, end, grain, std::forward<Func>(func));
+            else
+                func(begin, end);
+        }
+
+        /**
+         * @brief 周波数間引き型の全レベル(出力はビットリバース順)
+         * @note ブロック(2 * half_size)がcache_block以下になったら、ブロックごとに残りのレベルをまとめて計算する.
+         *       1レベルごとに配列全体を走査するとメモリ帯域で律速されるため.
+         */
+        template <bool Inverse>
+        static void dif_levels(std::uint32_t* fouriers, size_t size, const RotorVector& rotors, ThreadPool* pool, size_t extent)
+        {
+            size_t half_size = size / 2;
+            for (; half_size > 0 && 2 * half_size > cache_block; half_size /= 2)
+            {
+                dispatch(pool, 0, size / 2, [&](size_t first, size_t last) {
+                    butterfly<Inverse>(fouriers, rotors.data() + half_size - 1, half_size, first, last, extent);
+                });
+            }
+            if (half_size == 0)
+                return;
+
+            size_t block = 2 * half_size;
+            dispatch(pool, 0, size / block, [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; ++i)
+                {
+                    for (size_t h = half_size; h > 0; h /= 2)
+                    {
+                        butterfly<Inverse>(fouriers, rotors.data() + h - 1, h, i * half_size, (i + 1) * half_size, extent);
+                    }
+                }
+            }, 1);
+        }
+
+        /**
+         * @brief 時間間引き型の全レベル(入力はビットリバース順, 1/N化しない)
+         * @note dif_levelsと逆に、小さいレベルをブロックごとにまとめてから大きいレベルを計算する.
+         */
+        static void dit_levels(std::uint32_t* fouriers, size_t size, const RotorVector& rotors, ThreadPool* pool)
+        {
+            if (size < 2)
+                return;
+
+            size_t block = std::min(size, cache_block);
+            dispatch(pool, 0, size / block, [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; ++i)
+                {
+                    for (size_t h = 1; h < block; h *= 2)
+                    {
+                        butterfly_dit(fouriers, rotors.data() + h - 1, h, i * block / 2, (i + 1) * block / 2);
+                    }
+                }
+            }, 1);
+            for (size_t half_size = block; half_size < size; half_size *= 2)
+            {
+                dispatch(pool, 0, size / 2, [&](size_t first, size_t last) {
+                    butterfly_dit(fouriers, rotors.data() + half_size - 1, half_size, first, last);
+                });
+            }
+        }
+
+        template <bool Inverse>
+        static void transform(std::uint32_t* fouriers,
+                              size_t size,
+                              const RotorVector& rotors,
+                              const Workspace& workspace,
+                              ThreadPool* pool,
+                              size_t extent)
+        {
+            dif_levels<Inverse>(fouriers, size, rotors, pool, extent);
+
+            // ビットリバースの並べ替え. 逆変換では同時に1/Nする
+            const size_t* indice_map = workspace.indice_map.data();
+            std::uint32_t norm = Field::to(Field::inverse(std::uint32_t(size % Field::modulus)));
+            dispatch(pool, 0, size, [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; ++i)
+                {
+                    size_t j = indice_map[i];
+                    if (i < j)
+                    {
+                        auto f = fouriers[i];
+                        fouriers[i] = fouriers[j];
+                        fouriers[j] = f;
+                    }
+                    if constexpr (Inverse)
+                    {
+                        if (i <= j)
+                        {
+                            fouriers[i] = Field::mul(fouriers[i], norm);
+                            if (i < j)
+                                fouriers[j] = Field::mul(fouriers[j], norm);
+                        }
+                    }
+                }
+            });
+        }
+
+    public:
+        static size_t calc_size(size_t size)
+        {
+            return CooleyTurkey::calc_size(size);
+        }
+
+        /**
+         * @brief 回転子をMontgomery表現で作成
+         * @note バタフライの片側の長さh(= N/2, N/4, ..., 1)ごとに、そのレベルで使う ω_{2h}^k (k = 0...h-1) を
+         *       rotors[h-1...2h-2] に連続して並べる. CooleyTurkeyのように1つの表を間引いて参照すると、
+         *       大きな変換の中間レベルでキャッシュラインとTLBを使い潰すため.
+         * @note sizeはmax_size以下の2のべき乗.
+         */
+        static RotorVector calc_rotors(size_t size)
+        {
+            RotorVector rotors(std::max<size_t>(1, size - 1));
+            for (size_t h = 1; h < size; h *= 2)
+            {
+                std::uint32_t omega = Field::pow(Field::to(Field::primitive_root), (Field::modulus - 1) / (2 * h));
+                std::uint32_t w = Field::to(1);
+                for (size_t k = 0; k < h; ++k)
+                {
+                    rotors[h - 1 + k] = w;
+                    w = Field::mul(w, omega);
+                }
+            }
+            return rotors;
+        }
+
+        static Workspace make_workspace(size_t size)
+        {
+            return CooleyTurkey::make_workspace(size); // ビットリバースのインデックスマップはFFTと共通
+        }
+
+        /**
+         * @brief 呼び出し元のメモリ上でそのまま行うNTT
+         * @note ヒープ確保は行わない.
+         * @param fouriers 長さsizeの入出力(各要素はp未満)
+         * @param extent 先頭から何個までが元データか. 残りはゼロであること(入力の枝刈り)
+         */
+        static void ntt(std::uint32_t* fouriers,
+                        size_t size,
+                        const RotorVector& rotors,
+                        const Workspace& workspace,
+                        ThreadPool* pool = nullptr,
+                        size_t extent = full_extent)
+        {
+            transform<false>(fouriers, size, rotors, workspace, pool, extent);
+        }
+
+        /**
+         * @brief 呼び出し元のメモリ上でそのまま行う逆NTT(1/N化する)
+         */
+        static void intt(std::uint32_t* fouriers,
+                         size_t size,
+                         const RotorVector& rotors,
+                         const Workspace& workspace,
+                         ThreadPool* pool = nullptr)
+        {
+            transform<true>(fouriers, size, rotors, workspace, pool, full_extent);
+        }
+
+        /**
+         * @brief 並べ替えを省いたNTT(出力はビットリバース順)
+         * @note 変換領域で要素ごとの積をとるだけなら順序は関係ないので、intt_bit_reversedと組にして並べ替えを省く.
+         */
+        static void ntt_bit_reversed(std::uint32_t* fouriers,
+                                     size_t size,
+                                     const RotorVector& rotors,
+                                     ThreadPool* pool = nullptr,
+                                     size_t extent = full_extent)
+        {
+            dif_levels<false>(fouriers, size, rotors, pool, extent);
+        }
+
+        /**
+         * @brief ビットリバース順の入力に対する逆NTT(出力は自然な順, 1/N化する)
+         */
+        static void intt_bit_reversed(std::uint32_t* fouriers,
+                                      size_t size,
+                                      const RotorVector& rotors,
+                                      ThreadPool* pool = nullptr)
+        {
+            dit_levels(fouriers, size, rotors, pool);
+            std::uint32_t norm = Field::to(Field::inverse(std::uint32_t(size % Field::modulus)));
+            dispatch(pool, 0, size, [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; ++i)
+                {
+                    fouriers[i] = Field::mul(fouriers[i], norm);
+                }
+            });
+        }
+
+        /**
+         * @brief pを法とする巡回畳み込み(a, bは変換済み. 結果はaに上書き)
+         */
+        static void multiply(std::uint32_t* a, const std::uint32_t* b, size_t size, ThreadPool* pool = nullptr)
+        {
+            dispatch(pool, 0, size, [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; ++i)
+                {
+                    a[i] = Field::mul(a[i], Field::to(b[i]));
+                }
+            });
+        }
+
+        /**
+         * @brief pを法とする線形畳み込み
+         * @param out 長さa.size() + b.size() - 1以上の出力(通常の剰余)
+         * @return false 長さがmax_sizeを超える
+         */
+        template <class T>
+        static bool convolve(std::span<const T> a, std::span<const T> b, std::span<std::uint32_t> out, ThreadPool* pool = nullptr)
+        {
+            if (a.empty() || b.empty())
+                return true;
+            size_t length = a.size() + b.size() - 1;
+            size_t size = calc_size(length);
+            if (size > max_size || out.size() < length)
+                return false;
+
+            auto rotors = calc_rotors(size);
+            FourierVector fa(size);
+            FourierVector fb(size);
+            auto load = [&](FourierVector& f, std::span<const T> x) {
+                dispatch(pool, 0, size, [&](size_t first, size_t last) {
+                    for (size_t i = first; i < last; ++i)
+                    {
+                        f[i] = i < x.size() ? Field::residue(x[i]) : 0;
+                    }
+                });
+            };
+            load(fa, a);
+            load(fb, b);
+            ntt_bit_reversed(fa.data(), size, rotors, pool, a.size());
+            ntt_bit_reversed(fb.data(), size, rotors, pool, b.size());
+            multiply(fa.data(), fb.data(), size, pool);
+            intt_bit_reversed(fa.data(), size, rotors, pool);
+            std::copy(std::begin(fa), std::begin(fa) + length, std::begin(out));
+            return true;
+        }
+    };
+
+    /**
+     * @brief 3つの素数のNTTと中国剰余定理(Garner)による整数の正確な畳み込み
+     * @note 3つの素数の積Mは約2^90. 結果は64bitに収まれば正確(符号なしは2^64を法とした値になる).
+     * @note 変換長はNttPrime1, NttPrime2の制約から2^26(= 2^25項同士の積)まで.
+     */
+    class NumberTheoretic
+    {
+        using P1 = NttPrime1;
+        using P2 = NttPrime2;
+        using P3 = NttPrime3;
+
+        template <class Field>
+        using Transform = NumberTheoreticTransform<Field>;
+
+        template <class Func>
+        static void dispatch(ThreadPool* pool, size_t begin, size_t end, Func&& func)
+        {
+            if (pool)
+                pool->parallel_for(begin, end, CooleyTurkey::parallel_grain, std::forward<Func>(func));
+            else
+                func(begin, end);
+        }
+
+    public:
+        /*畳み込みの結果の型(符号付きの入力ならint64_t)*/
+        template <class T>
+        using Product = std::conditional_t<std::is_signed_v<T>, std::int64_t, std::uint64_t>;
+
+        static constexpr size_t max_size = std::min({P1::max_size, P2::max_size, P3::max_size});
+
+        /**
+         * @brief 整数列の線形畳み込み(多項式・多倍長整数の乗算)
+         * @note 入力の各要素は|x| < 2^32であること.
+         * @return 長さa.size() + b.size() - 1の畳み込み. 長さがmax_sizeを超える場合は空.
+         */
+        template <class T>
+        static std::vector<Product<T>> convolve(std::span<const T> a, std::span<const T> b, ThreadPool* pool = nullptr)
+        {
+            static_assert(std::is_integral_v<T>, "NumberTheoretic::convolve requires integral input");
+            if (a.empty() || b.empty())
+                return {};
+            size_t length = a.size() + b.size() - 1;
+            if (CooleyTurkey::calc_size(length) > max_size)
+                return {};
+
+            // 素数ごとの剰余. 作業領域は素数ごとに確保して解放する
+            std::vector<std::uint32_t> r1(length);
+            std::vector<std::uint32_t> r2(length);
+            std::vector<std::uint32_t> r3(length);
+            Transform<P1>::convolve(a, b, std::span<std::uint32_t>(r1), pool);
+            Transform<P2>::convolve(a, b, std::span<std::uint32_t>(r2), pool);
+            Transform<P3>::convolve(a, b, std::span<std::uint32_t>(r3), pool);
+
+            // Garner: x = v1 + p1*v2 + p1*p2*v3 (0 <= x < M)
+            constexpr std::uint32_t p1_inv_2 = P2::to(P2::inverse(P1::modulus % P2::modulus));
+            constexpr std::uint32_t p1_inv_3 = P3::to(P3::inverse(P1::modulus % P3::modulus));
+            constexpr std::uint32_t p2_inv_3 = P3::to(P3::inverse(P2::modulus % P3::modulus));
+            constexpr std::uint64_t p12 = std::uint64_t(P1::modulus) * P2::modulus;
+            constexpr std::uint64_t m = p12 * P3::modulus; // 2^64を法とする(符号付きで負にするときに使う)
+
+            std::vector<Product<T>> out(length);
+            dispatch(pool, 0, length, [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; ++i)
+                {
+                    std::uint32_t v1 = r1[i];
+                    std::uint32_t v2 = P2::mul(P2::sub(r2[i], v1 % P2::modulus), p1_inv_2);
+                    std::uint32_t t3 = P3::mul(P3::sub(r3[i], v1 % P3::modulus), p1_inv_3);
+                    std::uint32_t v3 = P3::mul(P3::sub(t3, v2 % P3::modulus), p2_inv_3);
+                    std::uint64_t low = v1 + std::uint64_t(P1::modulus) * v2; // < p1*p2
+                    std::uint64_t x = low + p12 * v3;                         // 2^64を法とする
+                    if constexpr (std::is_signed_v<T>)
+                    {
+                        // x >= M/2 なら負の値 x - M
+                        constexpr std::uint32_t half3 = P3::modulus / 2;
+                        if (v3 > half3 || (v3 == half3 && low >= p12 / 2 + 1))
+                            x -= m;
+                        out[i] = static_cast<std::int64_t>(x);
+                    }
+                    else
+                    {
+                        out[i] = x;
+                    }
+                }
+            });
+            return out;
+        }
+
+        /**
+         * @brief 整数画像の2次元線形畳み込み
+         * @note 行の間隔をa_width + b_width - 1に広げて1次元に並べると、行をまたいだ回り込みが起きないので1次元の畳み込みで計算できる.
+         * @return (a_width + b_width - 1) x (a_height + b_height - 1) の行優先の畳み込み. 大きすぎる場合は空.
+         */
+        template <class T>
+        static std::vector<Product<T>> convolve_2d(std::span<const T> a, size_t a_width, size_t a_height,
+                                                   std::span<const T> b, size_t b_width, size_t b_height,
+                                                   ThreadPool* pool = nullptr)
+        {
+            if (a_width * a_height == 0 || b_width * b_height == 0 ||
+                a.size() < a_width * a_height || b.size() < b_width * b_height)
+                return {};
+            size_t stride = a_width + b_width - 1;
+            size_t height = a_height + b_height - 1;
+
+            auto embed = [&](std::span<const T> x, size_t width, size_t rows) {
+                std::vector<T> embedded((rows - 1) * stride + width, T(0));
+                for (size_t y = 0; y < rows; ++y)
+                {
+                    std::copy(x.begin() + y * width, x.begin() + (y + 1) * width, embedded.begin() + y * stride);
+                }
+                return embedded;
+            };
+            auto ea = embed(a, a_width, a_height);
+            auto eb = embed(b, b_width, b_height);
+
+            auto c = convolve(std::span<const T>(ea), std::span<const T>(eb), pool);
+            if (c.empty())
+                return {};
+            c.resize(height * stride, 0); // 最終行の右端は常にゼロ
+            return c;
+        }
+    };
+}
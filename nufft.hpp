@@ -0,0 +1,523 @@
+#pragma once
+
+#include "fft_policy.hpp"
+
+#include <complex>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <span>
+#include <cmath>
+
+
+namespace fft
+{
+    /**
+     * @brief NUFFTのGaussianカーネルのパラメータ(Greengard-Lee)
+     * @note 過剰標本化率R = 2, 許容誤差epsに対して
+     *       片側の広がり Msp = ceil{-ln(eps) * (R - 0.5) / (pi * (R - 1))}
+     *       分散 tau = pi * Msp / {M^2 * R * (R - 0.5)} (Mはモード数)
+     */
+    struct GaussianKernel
+    {
+        static constexpr double oversampling = 2.0;
+
+        size_t spread; // Msp
+        double tau;
+
+        GaussianKernel() : spread(0), tau(0.0) {}
+
+        GaussianKernel(size_t num_modes, double tolerance)
+        {
+            const double pi = 3.141592653589793;
+            const double r = oversampling;
+            double msp = std::ceil(-std::log(tolerance) * (r - 0.5) / (pi * (r - 1.0)));
+            spread = (size_t)std::max(2.0, msp);
+            tau = pi * spread / ((double)num_modes * num_modes * r * (r - 0.5));
+        }
+
+        /**
+         * @brief 逆畳み込みの係数 sqrt(pi/tau) * exp{k^2 * tau}
+         */
+        double deconvolution(double k) const
+        {
+            return std::sqrt(3.141592653589793 / tau) * std::exp(k * k * tau);
+        }
+
+        /**
+         * @brief 高速Gaussian gridding
+         * @note 格子間隔h = 2*pi/Mrで、格子点m0 + lでの値は exp{-(d - h*l)^2/(4*tau)} = E1 * E2^l * E3(l).
+         *       E1 = exp{-d^2/(4*tau)}, E2 = exp{d*pi/(Mr*tau)}, E3(l) = exp{-(pi*l/Mr)^2/tau}
+         *       点ごとにexpは2回で済む.
+         *
+         * @param x 位置[0, 2*pi)
+         * @param grid_size Mr
+         * @param e3 E3(l)の表(l = 0...Msp)
+         * @param weights 長さ2*Msp. weights[i]は格子点m0 - Msp + 1 + iの重み
+         * @return m0 - Msp + 1 (Mrを法とする前の値)
+         */
+        long long weights(double x, size_t grid_size, const std::vector<double>& e3, double* weights) const
+        {
+            const double h = 2.0 * 3.141592653589793 / grid_size;
+            long long m0 = (long long)std::floor(x / h);
+            double d = x - m0 * h;
+            double e1 = std::exp(-d * d / (4.0 * tau));
+            double e2 = std::exp(d * 3.141592653589793 / (grid_size * tau));
+
+            size_t center = spread - 1; // l = 0の位置
+            weights[center] = e1;
+            double p = e1;
+            for (size_t l = 1; l <= spread; ++l)
+            {
+                p *= e2;
+                weights[center + l] = p * e3[l];
+            }
+            p = e1;
+            double e2_inv = 1.0 / e2;
+            for (size_t l = 1; l < spread; ++l)
+            {
+                p *= e2_inv;
+                weights[center - l] = p * e3[l];
+            }
+            return m0 - (long long)spread + 1;
+        }
+
+        std::vector<double> make_e3(size_t grid_size) const
+        {
+            std::vector<double> e3(spread + 1);
+            for (size_t l = 0; l <= spread; ++l)
+            {
+                double a = 3.141592653589793 * l / grid_size;
+                e3[l] = std::exp(-a * a / tau);
+            }
+            return e3;
+        }
+    };
+}
+
+
+/**
+ * @brief 非一様FFT(NUFFT)
+ * @note 位置t_jは標本単位の実数(周期size()). 整数の位置ならFourier::fftと同じ係数になる.
+ * @note type1: F_k = 1/N * Σ_j{c_j * exp{+j*2*pi*k*t_j/N}}        (非一様な点 -> 一様なモード)
+ * @note type2: c_j = Σ_k{F_k * exp{-j*2*pi*k*t_j/N}}              (一様なモード -> 非一様な点, type1の逆向き)
+ * @note モードkは-N/2...N/2-1で、fourier_coef()と同じくFFTの順(負の周波数が後半)に並べる.
+ * @note Gaussianカーネルで2倍に過剰標本化した格子に拡散し、FftPolicyのFFTを1回行ってから逆畳み込みする.
+ *       計算量はO(点数 * Msp + N log N). 点の拡散はスレッドごとの格子に並列に行い、最後に足し合わせる.
+ */
+template <class FftPolicy>
+class NonUniformFourier
+{
+    using FourierCoef = std::complex<double>;
+    using FourierVector = typename FftPolicy::FourierVector;
+
+    size_t size_;      // モード数N
+    size_t grid_size_; // 過剰標本化した格子の大きさMr
+    fft::GaussianKernel kernel_;
+    std::vector<double> e3_;
+    std::vector<double> deconvolution_; // FFTの順に並べた逆畳み込みの係数
+
+    typename FftPolicy::RotorVector rotors_;
+    typename FftPolicy::Workspace workspace_;
+
+    /**
+     * @brief 拡散先の格子(スレッドごと). grids_[0]はFFTにも使う
+     */
+    std::vector<FourierVector> grids_;
+
+    std::shared_ptr<fft::ThreadPool> pool_;
+
+    double to_angle(double position) const
+    {
+        double x = std::fmod(position, (double)size_);
+        if (x < 0.0)
+            x += size_;
+        double angle = 2.0 * 3.141592653589793 * x / size_;
+        return angle < 2.0 * 3.141592653589793 ? angle : 0.0;
+    }
+
+    size_t wrap(long long index) const
+    {
+        long long m = index % (long long)grid_size_;
+        return (size_t)(m < 0 ? m + (long long)grid_size_ : m);
+    }
+
+    template <class Func>
+    void dispatch(size_t begin, size_t end, size_t grain, Func&& func)
+    {
+        if (pool_)
+            pool_->parallel_for(begin, end, grain, std::forward<Func>(func));
+        else
+            func(begin, end);
+    }
+
+public:
+    /**
+     * @brief Construct a new Non Uniform Fourier object
+     *
+     * @param size モード数. 2のべき乗に切り上げられる
+     * @param tolerance 許容する相対誤差(1e-15程度まで)
+     * @param pool 拡散とFFTを並列化するスレッドプール
+     */
+    NonUniformFourier(size_t size, double tolerance = 1e-12, std::shared_ptr<fft::ThreadPool> pool = nullptr)
+        : pool_(std::move(pool))
+    {
+        size_ = FftPolicy::calc_size(size);
+        grid_size_ = FftPolicy::calc_size((size_t)(fft::GaussianKernel::oversampling * size_));
+        kernel_ = fft::GaussianKernel(size_, tolerance);
+        e3_ = kernel_.make_e3(grid_size_);
+
+        deconvolution_.resize(size_);
+        for (size_t k = 0; k < size_; ++k)
+        {
+            double freq = k < size_ / 2 ? (double)k : (double)k - (double)size_;
+            deconvolution_[k] = kernel_.deconvolution(freq);
+        }
+
+        rotors_ = FftPolicy::calc_rotors(grid_size_);
+        workspace_ = FftPolicy::make_workspace(grid_size_);
+        grids_.resize(pool_ ? pool_->size() : 1);
+        for (auto& grid : grids_) { grid.resize(grid_size_); }
+    }
+
+    virtual ~NonUniformFourier() {};
+    NonUniformFourier(const NonUniformFourier&) = default;
+    NonUniformFourier& operator=(const NonUniformFourier&) = default;
+    NonUniformFourier(NonUniformFourier&&) = default;
+    NonUniformFourier& operator=(NonUniformFourier&&) = default;
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    size_t grid_size() const
+    {
+        return grid_size_;
+    }
+
+    size_t spread_width() const
+    {
+        return 2 * kernel_.spread;
+    }
+
+    /**
+     * @brief type1 NUFFT(非一様な点 -> 一様なモード)
+     *
+     * @param positions 点の位置(標本単位, 周期size())
+     * @param strengths 点の値(実数または複素数)
+     * @param count 点の数
+     * @param out 長さsize()の出力(FFTの順)
+     */
+    template <class T>
+    bool type1(const double* positions, const T* strengths, size_t count, std::span<FourierCoef> out)
+    {
+        if (out.size() != size_)
+            return false;
+
+        // 1. スレッドごとの格子に拡散する
+        size_t n_grids = std::min(grids_.size(), std::max<size_t>(1, count));
+        dispatch(0, n_grids, 1, [&](size_t first, size_t last) {
+            std::vector<double> weights(2 * kernel_.spread);
+            for (size_t g = first; g < last; ++g)
+            {
+                auto& grid = grids_[g];
+                std::fill(std::begin(grid), std::end(grid), FourierCoef(0.0, 0.0));
+                size_t begin = count * g / n_grids;
+                size_t end = count * (g + 1) / n_grids;
+                for (size_t j = begin; j < end; ++j)
+                {
+                    long long m = kernel_.weights(to_angle(positions[j]), grid_size_, e3_, weights.data());
+                    FourierCoef c(strengths[j]);
+                    for (size_t i = 0; i < weights.size(); ++i)
+                    {
+                        grid[wrap(m + (long long)i)] += weights[i] * c;
+                    }
+                }
+            }
+        });
+
+        // 2. 格子を足し合わせる
+        auto& grid = grids_[0];
+        if (n_grids > 1)
+        {
+            dispatch(0, grid_size_, FftPolicy::parallel_grain, [&](size_t first, size_t last) {
+                for (size_t g = 1; g < n_grids; ++g)
+                {
+                    for (size_t m = first; m < last; ++m) { grid[m] += grids_[g][m]; }
+                }
+            });
+        }
+
+        // 3. FFT(1/Mr化される)と逆畳み込み
+        FftPolicy::fft(grid.data(), grid_size_, rotors_, workspace_, pool_.get());
+        for (size_t k = 0; k < size_; ++k)
+        {
+            size_t m = k < size_ / 2 ? k : grid_size_ - (size_ - k);
+            out[k] = grid[m] * (deconvolution_[k] / size_);
+        }
+        return true;
+    }
+
+    /**
+     * @brief type2 NUFFT(一様なモード -> 非一様な点)
+     *
+     * @param coefs 長さsize()のモード(FFTの順)
+     * @param positions 点の位置(標本単位, 周期size())
+     * @param count 点の数
+     * @param out 長さcount以上の出力
+     */
+    bool type2(std::span<const FourierCoef> coefs, const double* positions, size_t count, std::span<FourierCoef> out)
+    {
+        if (coefs.size() != size_ || out.size() < count)
+            return false;
+
+        // 1. 逆畳み込みして格子に置き、逆FFT
+        auto& grid = grids_[0];
+        std::fill(std::begin(grid), std::end(grid), FourierCoef(0.0, 0.0));
+        for (size_t k = 0; k < size_; ++k)
+        {
+            size_t m = k < size_ / 2 ? k : grid_size_ - (size_ - k);
+            grid[m] = coefs[k] * deconvolution_[k];
+        }
+        FftPolicy::ifft(grid.data(), grid_size_, rotors_, workspace_, pool_.get());
+
+        // 2. 各点へ補間する(点ごとに独立)
+        const double scale = 1.0 / grid_size_;
+        dispatch(0, count, 1024, [&](size_t first, size_t last) {
+            std::vector<double> weights(2 * kernel_.spread);
+            for (size_t j = first; j < last; ++j)
+            {
+                long long m = kernel_.weights(to_angle(positions[j]), grid_size_, e3_, weights.data());
+                FourierCoef sum(0.0, 0.0);
+                for (size_t i = 0; i < weights.size(); ++i)
+                {
+                    sum += weights[i] * grid[wrap(m + (long long)i)];
+                }
+                out[j] = sum * scale;
+            }
+        });
+        return true;
+    }
+};
+
+
+/**
+ * @brief 2次元の非一様FFT
+ * @note 位置(x_j, y_j)は標本単位(周期width(), height())で、モードは[height][width]の行優先・各軸FFTの順.
+ * @note type1: F_{k,l} = 1/(W*H) * Σ_j{c_j * exp{+j*2*pi*(k*x_j/W + l*y_j/H)}}
+ * @note type2: c_j = Σ_{k,l}{F_{k,l} * exp{-j*2*pi*(k*x_j/W + l*y_j/H)}}
+ * @note カーネルは軸ごとのGaussianの積. 格子のFFTはFftPolicy::fft2dを使い、逆変換は共役をとって順変換で行う.
+ */
+template <class FftPolicy>
+class NonUniformFourier2D
+{
+    using FourierCoef = std::complex<double>;
+    using FourierVector = typename FftPolicy::FourierVector;
+
+    size_t width_;
+    size_t height_;
+    size_t grid_width_;
+    size_t grid_height_;
+    fft::GaussianKernel kernel_x_;
+    fft::GaussianKernel kernel_y_;
+    std::vector<double> e3_x_;
+    std::vector<double> e3_y_;
+    std::vector<double> deconvolution_x_;
+    std::vector<double> deconvolution_y_;
+
+    typename FftPolicy::RotorVector rotors_width_;
+    typename FftPolicy::RotorVector rotors_height_;
+    typename FftPolicy::Workspace2D workspace_;
+
+    std::vector<FourierVector> grids_;
+
+    std::shared_ptr<fft::ThreadPool> pool_;
+
+    static double to_angle(double position, size_t period)
+    {
+        double x = std::fmod(position, (double)period);
+        if (x < 0.0)
+            x += period;
+        double angle = 2.0 * 3.141592653589793 * x / period;
+        return angle < 2.0 * 3.141592653589793 ? angle : 0.0;
+    }
+
+    static size_t wrap(long long index, size_t period)
+    {
+        long long m = index % (long long)period;
+        return (size_t)(m < 0 ? m + (long long)period : m);
+    }
+
+    static std::vector<double> make_deconvolution(const fft::GaussianKernel& kernel, size_t size)
+    {
+        std::vector<double> deconvolution(size);
+        for (size_t k = 0; k < size; ++k)
+        {
+            double freq = k < size / 2 ? (double)k : (double)k - (double)size;
+            deconvolution[k] = kernel.deconvolution(freq);
+        }
+        return deconvolution;
+    }
+
+    template <class Func>
+    void dispatch(size_t begin, size_t end, size_t grain, Func&& func)
+    {
+        if (pool_)
+            pool_->parallel_for(begin, end, grain, std::forward<Func>(func));
+        else
+            func(begin, end);
+    }
+
+    /*モードkの格子上の添字*/
+    static size_t grid_index(size_t k, size_t size, size_t grid_size)
+    {
+        return k < size / 2 ? k : grid_size - (size - k);
+    }
+
+public:
+    NonUniformFourier2D(size_t width, size_t height, double tolerance = 1e-12, std::shared_ptr<fft::ThreadPool> pool = nullptr)
+        : pool_(std::move(pool))
+    {
+        width_ = FftPolicy::calc_size(width);
+        height_ = FftPolicy::calc_size(height);
+        grid_width_ = FftPolicy::calc_size((size_t)(fft::GaussianKernel::oversampling * width_));
+        grid_height_ = FftPolicy::calc_size((size_t)(fft::GaussianKernel::oversampling * height_));
+        kernel_x_ = fft::GaussianKernel(width_, tolerance);
+        kernel_y_ = fft::GaussianKernel(height_, tolerance);
+        e3_x_ = kernel_x_.make_e3(grid_width_);
+        e3_y_ = kernel_y_.make_e3(grid_height_);
+        deconvolution_x_ = make_deconvolution(kernel_x_, width_);
+        deconvolution_y_ = make_deconvolution(kernel_y_, height_);
+
+        rotors_width_ = FftPolicy::calc_rotors(grid_width_);
+        rotors_height_ = FftPolicy::calc_rotors(grid_height_);
+        workspace_ = FftPolicy::make_workspace_2d(grid_width_, grid_height_);
+        grids_.resize(pool_ ? pool_->size() : 1);
+        for (auto& grid : grids_) { grid.resize(grid_width_ * grid_height_); }
+    }
+
+    virtual ~NonUniformFourier2D() {};
+    NonUniformFourier2D(const NonUniformFourier2D&) = default;
+    NonUniformFourier2D& operator=(const NonUniformFourier2D&) = default;
+    NonUniformFourier2D(NonUniformFourier2D&&) = default;
+    NonUniformFourier2D& operator=(NonUniformFourier2D&&) = default;
+
+    size_t width() const
+    {
+        return width_;
+    }
+
+    size_t height() const
+    {
+        return height_;
+    }
+
+    /**
+     * @brief type1 NUFFT(非一様な点 -> 一様なモード)
+     * @param out 長さwidth() * height()の出力
+     */
+    template <class T>
+    bool type1(const double* xs, const double* ys, const T* strengths, size_t count, std::span<FourierCoef> out)
+    {
+        if (out.size() != width_ * height_)
+            return false;
+
+        size_t n_grids = std::min(grids_.size(), std::max<size_t>(1, count));
+        dispatch(0, n_grids, 1, [&](size_t first, size_t last) {
+            std::vector<double> wx(2 * kernel_x_.spread);
+            std::vector<double> wy(2 * kernel_y_.spread);
+            for (size_t g = first; g < last; ++g)
+            {
+                auto& grid = grids_[g];
+                std::fill(std::begin(grid), std::end(grid), FourierCoef(0.0, 0.0));
+                size_t begin = count * g / n_grids;
+                size_t end = count * (g + 1) / n_grids;
+                for (size_t j = begin; j < end; ++j)
+                {
+                    long long mx = kernel_x_.weights(to_angle(xs[j], width_), grid_width_, e3_x_, wx.data());
+                    long long my = kernel_y_.weights(to_angle(ys[j], height_), grid_height_, e3_y_, wy.data());
+                    FourierCoef c(strengths[j]);
+                    for (size_t iy = 0; iy < wy.size(); ++iy)
+                    {
+                        FourierCoef cy = wy[iy] * c;
+                        FourierCoef* row = grid.data() + wrap(my + (long long)iy, grid_height_) * grid_width_;
+                        for (size_t ix = 0; ix < wx.size(); ++ix)
+                        {
+                            row[wrap(mx + (long long)ix, grid_width_)] += wx[ix] * cy;
+                        }
+                    }
+                }
+            }
+        });
+
+        auto& grid = grids_[0];
+        if (n_grids > 1)
+        {
+            dispatch(0, grid.size(), FftPolicy::parallel_grain, [&](size_t first, size_t last) {
+                for (size_t g = 1; g < n_grids; ++g)
+                {
+                    for (size_t m = first; m < last; ++m) { grid[m] += grids_[g][m]; }
+                }
+            });
+        }
+
+        FftPolicy::fft2d(grid, rotors_width_, rotors_height_, workspace_, pool_.get());
+        for (size_t l = 0; l < height_; ++l)
+        {
+            const FourierCoef* row = grid.data() + grid_index(l, height_, grid_height_) * grid_width_;
+            for (size_t k = 0; k < width_; ++k)
+            {
+                double factor = deconvolution_x_[k] * deconvolution_y_[l] / ((double)width_ * height_);
+                out[l * width_ + k] = row[grid_index(k, width_, grid_width_)] * factor;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief type2 NUFFT(一様なモード -> 非一様な点)
+     * @param coefs 長さwidth() * height()のモード
+     */
+    bool type2(std::span<const FourierCoef> coefs, const double* xs, const double* ys, size_t count, std::span<FourierCoef> out)
+    {
+        if (coefs.size() != width_ * height_ || out.size() < count)
+            return false;
+
+        // 逆FFT = 共役 -> 順FFT(1/(Mx*My)化) -> 共役. 格子の大きさ倍は補間の係数と打ち消す
+        auto& grid = grids_[0];
+        std::fill(std::begin(grid), std::end(grid), FourierCoef(0.0, 0.0));
+        for (size_t l = 0; l < height_; ++l)
+        {
+            FourierCoef* row = grid.data() + grid_index(l, height_, grid_height_) * grid_width_;
+            for (size_t k = 0; k < width_; ++k)
+            {
+                row[grid_index(k, width_, grid_width_)] = std::conj(coefs[l * width_ + k]) * (deconvolution_x_[k] * deconvolution_y_[l]);
+            }
+        }
+        FftPolicy::fft2d(grid, rotors_width_, rotors_height_, workspace_, pool_.get());
+
+        dispatch(0, count, 256, [&](size_t first, size_t last) {
+            std::vector<double> wx(2 * kernel_x_.spread);
+            std::vector<double> wy(2 * kernel_y_.spread);
+            for (size_t j = first; j < last; ++j)
+            {
+                long long mx = kernel_x_.weights(to_angle(xs[j], width_), grid_width_, e3_x_, wx.data());
+                long long my = kernel_y_.weights(to_angle(ys[j], height_), grid_height_, e3_y_, wy.data());
+                FourierCoef sum(0.0, 0.0);
+                for (size_t iy = 0; iy < wy.size(); ++iy)
+                {
+                    const FourierCoef* row = grid.data() + wrap(my + (long long)iy, grid_height_) * grid_width_;
+                    FourierCoef sum_x(0.0, 0.0);
+                    for (size_t ix = 0; ix < wx.size(); ++ix)
+                    {
+                        sum_x += wx[ix] * row[wrap(mx + (long long)ix, grid_width_)];
+                    }
+                    sum += wy[iy] * sum_x;
+                }
+                out[j] = std::conj(sum);
+            }
+        });
+        return true;
+    }
+};
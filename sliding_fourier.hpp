@@ -0,0 +1,200 @@
+#pragma once
+
+#include "fourier.hpp"
+
+#include <complex>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <span>
+
+
+/**
+ * @brief スライディングDFT
+ * @note 直近size()個のサンプルのスペクトルを、サンプルが1つ来るたびに更新する.
+ * @note 窓をずらすと X'_k = conj(W_k) * {X_k + (x_new - x_old)/N} となるので、
+ *       全ビンの更新はO(N)/サンプル、指定したビンだけならO(1)/ビン/サンプル.
+ * @note 漸化式の丸め誤差が溜まるので、reanchor_interval個ごとに窓全体をFFTし直して誤差をリセットする.
+ * @note 係数はFourier::fourier_coef()と同じ形式(1/N化, 窓の先頭が最も古いサンプル).
+ */
+template <class FftPolicy>
+class SlidingFourier
+{
+    using FourierCoef = std::complex<double>;
+    using FourierVector = typename FftPolicy::FourierVector;
+    using DataVector = fft::BufferVector<double>;
+
+    /**
+     * @brief 回転子と再アンカー用のFFT
+     */
+    Fourier<FftPolicy> fourier_;
+
+    /**
+     * @brief 直近N個のサンプル(リングバッファ)
+     * @note head_が最も古いサンプルの位置
+     */
+    DataVector window_;
+    size_t head_;
+
+    /**
+     * @brief 現在の窓の複素フーリエ係数(1/N化済み)
+     * @note bins_を指定した場合は、そのビンだけが最新.
+     */
+    FourierVector spectrum_;
+
+    /**
+     * @brief 追跡するビン(空なら全ビン)
+     */
+    std::vector<size_t> bins_;
+
+    /**
+     * @brief 再アンカー用の作業領域(窓を時系列順に並べたもの)
+     */
+    DataVector linear_;
+    FourierVector scratch_;
+
+    size_t reanchor_interval_;
+    size_t count_;
+
+public:
+    /**
+     * @brief Construct a new Sliding Fourier object
+     *
+     * @param size 窓の長さ. Fourierと同じく2のべき乗に切り上げられる
+     * @param reanchor_interval 何サンプルごとにFFTで作り直すか. 0なら作り直さない
+     * @param bins 追跡するビン. 空なら全ビンを更新する
+     * @param pool 再アンカーのFFTを並列化するスレッドプール
+     */
+    SlidingFourier(size_t size,
+                   size_t reanchor_interval,
+                   std::vector<size_t> bins = {},
+                   std::shared_ptr<fft::ThreadPool> pool = nullptr)
+        : fourier_(size, std::move(pool))
+        , head_(0)
+        , bins_(std::move(bins))
+        , reanchor_interval_(reanchor_interval)
+        , count_(0)
+    {
+        size_t n = fourier_.size();
+        window_.assign(n, 0.0);
+        spectrum_.assign(n, FourierCoef(0.0, 0.0));
+        linear_.resize(n);
+        scratch_.resize(n);
+        for (auto& k : bins_) { k %= n; }
+    }
+
+    explicit SlidingFourier(size_t size)
+        : SlidingFourier(size, FftPolicy::calc_size(size))
+    {}
+
+    virtual ~SlidingFourier() {};
+    SlidingFourier(const SlidingFourier&) = default;
+    SlidingFourier& operator=(const SlidingFourier&) = default;
+    SlidingFourier(SlidingFourier&&) = default;
+    SlidingFourier& operator=(SlidingFourier&&) = default;
+
+    size_t size() const
+    {
+        return fourier_.size();
+    }
+
+    const std::vector<size_t>& bins() const
+    {
+        return bins_;
+    }
+
+    /**
+     * @brief サンプルを1つ追加して、スペクトルを更新する
+     */
+    void update(double sample)
+    {
+        size_t n = window_.size();
+        const auto& rotors = fourier_.rotors();
+        FourierCoef delta((sample - window_[head_]) / n, 0.0);
+        window_[head_] = sample;
+        if (++head_ == n)
+            head_ = 0;
+
+        if (bins_.empty())
+        {
+            for (size_t k = 0; k < n; ++k)
+            {
+                spectrum_[k] = std::conj(rotors[k]) * (spectrum_[k] + delta);
+            }
+        }
+        else
+        {
+            for (size_t k : bins_)
+            {
+                spectrum_[k] = std::conj(rotors[k]) * (spectrum_[k] + delta);
+            }
+        }
+
+        if (reanchor_interval_ > 0 && ++count_ >= reanchor_interval_)
+            reanchor();
+    }
+
+    template <class T>
+    void update(const T* samples, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            update((double)samples[i]);
+        }
+    }
+
+    /**
+     * @brief 現在の窓からスペクトルを計算し直す(誤差のリセット)
+     * @note 全ビンならFFT、追跡するビンが少なければGoertzel(Fourier::bins)で計算する.
+     */
+    void reanchor()
+    {
+        size_t n = window_.size();
+        std::copy(std::begin(window_) + head_, std::end(window_), std::begin(linear_));
+        std::copy(std::begin(window_), std::begin(window_) + head_, std::begin(linear_) + (n - head_));
+        count_ = 0;
+
+        size_t n_level = 0;
+        while ((size_t(1) << n_level) < n) { ++n_level; }
+
+        if (bins_.empty() || bins_.size() > n_level)
+        {
+            fourier_.fft(std::span<const double>(linear_.data(), n),
+                         std::span<FourierCoef>(scratch_.data(), n));
+            if (bins_.empty())
+            {
+                std::swap(spectrum_, scratch_);
+            }
+            else
+            {
+                for (size_t k : bins_) { spectrum_[k] = scratch_[k]; }
+            }
+        }
+        else
+        {
+            fourier_.bins(linear_.data(), n,
+                          std::span<const size_t>(bins_),
+                          std::span<FourierCoef>(scratch_.data(), bins_.size()));
+            for (size_t i = 0; i < bins_.size(); ++i) { spectrum_[bins_[i]] = scratch_[i]; }
+        }
+    }
+
+    /**
+     * @brief 現在の窓の複素フーリエ係数
+     * @note bins()を指定した場合は、そのビンだけが有効.
+     */
+    const FourierVector& spectrum() const
+    {
+        return spectrum_;
+    }
+
+    std::span<const FourierCoef> spectrum_view() const
+    {
+        return std::span<const FourierCoef>(spectrum_.data(), spectrum_.size());
+    }
+
+    FourierCoef coef(size_t k) const
+    {
+        return spectrum_[k % spectrum_.size()];
+    }
+};
@@ -0,0 +1,460 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <type_traits>
+#include <concepts>
+#include <string>
+#include <fstream>
+#include <sstream>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+namespace fft
+{
+    /**
+     * @brief 変換内部の並列化とバッチ実行に使うワークスティーリング型スレッドプール
+     * @note ワーカーごとに両端キューを持ち、自分のキューは末尾(LIFO)から、他のキューは先頭から盗む.
+     * @note キューごとにロックを分けているので、単一のグローバルロックで詰まらない.
+     * @note parallel_forを呼んだスレッド自身も分割した区間の処理に参加し、
+     *       待機中は他のタスクを手伝うので、入れ子で呼んでもデッドロックしない.
+     * @note parallel_for_staticは区間の分割とワーカーの対応を固定する.
+     *       同じ分割で初期化(ファーストタッチ)と変換を行えば、各スレッドは自ノードのメモリを主に触る.
+     *       担当のワーカーが他のタスクを実行中なら、その区間は通常のタスクとして積み、他のスレッドに盗ませる.
+     */
+    class ThreadPool
+    {
+        struct WorkQueue
+        {
+            std::deque<std::function<void()>> tasks;
+            std::deque<std::function<void()>> pinned; // このワーカーが優先して実行するタスク
+            std::mutex mtx;
+            std::atomic<size_t> pinned_count{0}; // pinnedに積まれて未取得のタスク数
+            std::atomic<bool> busy{false};       // ワーカーがタスクを探しているか実行中
+        };
+
+        std::vector<std::unique_ptr<WorkQueue>> queues_; // ワーカーごとのキュー
+        std::vector<std::thread> workers_;
+        std::atomic<size_t> pending_;    // tasksに積まれて未取得のタスク数(どのワーカーも取れる)
+        std::atomic<size_t> next_queue_; // 外部スレッドから積むときの振り分け先
+        std::atomic<bool> stop_;
+        std::mutex sleep_mtx_;
+        std::condition_variable cv_;
+
+        /*現在のスレッドがどのプールの何番目のワーカーか*/
+        struct WorkerInfo
+        {
+            const ThreadPool* owner = nullptr;
+            size_t index = 0;
+        };
+
+        static WorkerInfo& this_worker()
+        {
+            thread_local WorkerInfo info;
+            return info;
+        }
+
+        bool is_own_worker() const
+        {
+            return this_worker().owner == this;
+        }
+
+        void push(std::function<void()> task)
+        {
+            size_t index = is_own_worker()
+                ? this_worker().index
+                : next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+            pending_.fetch_add(1, std::memory_order_release);
+            std::lock_guard<std::mutex> lock(queues_[index]->mtx);
+            queues_[index]->tasks.push_back(std::move(task));
+        }
+
+        void push_pinned(size_t index, std::function<void()> task)
+        {
+            WorkQueue& queue = *queues_[index];
+            if (queue.busy.load(std::memory_order_acquire))
+            {
+                // 担当が塞がっているので、待たずに他のスレッドに盗ませる
+                pending_.fetch_add(1, std::memory_order_release);
+                std::lock_guard<std::mutex> lock(queue.mtx);
+                queue.tasks.push_front(std::move(task));
+                return;
+            }
+            queue.pinned_count.fetch_add(1, std::memory_order_release);
+            std::lock_guard<std::mutex> lock(queue.mtx);
+            queue.pinned.push_back(std::move(task));
+        }
+
+        void wake_up(bool all)
+        {
+            // ワーカーが述語を確認してから眠るまでの間に通知が消えないようにロックを通す
+            { std::lock_guard<std::mutex> lock(sleep_mtx_); }
+            if (all)
+                cv_.notify_all();
+            else
+                cv_.notify_one();
+        }
+
+        bool try_pop(std::function<void()>& task)
+        {
+            size_t n_queues = queues_.size();
+            size_t start = 0;
+            if (is_own_worker())
+            {
+                // 固定されたタスクを優先し、次に自分のキューの末尾から取る
+                start = this_worker().index;
+                WorkQueue& own = *queues_[start];
+                std::lock_guard<std::mutex> lock(own.mtx);
+                if (!own.pinned.empty())
+                {
+                    task = std::move(own.pinned.front());
+                    own.pinned.pop_front();
+                    own.pinned_count.fetch_sub(1, std::memory_order_acq_rel);
+                    return true;
+                }
+                if (!own.tasks.empty())
+                {
+                    task = std::move(own.tasks.back());
+                    own.tasks.pop_back();
+                    pending_.fetch_sub(1, std::memory_order_acq_rel);
+                    return true;
+                }
+            }
+
+            // 他のワーカーのキューの先頭から盗む
+            for (size_t i = 1; i <= n_queues; ++i)
+            {
+                WorkQueue& victim = *queues_[(start + i) % n_queues];
+                std::lock_guard<std::mutex> lock(victim.mtx);
+                if (!victim.tasks.empty())
+                {
+                    task = std::move(victim.tasks.front());
+                    victim.tasks.pop_front();
+                    pending_.fetch_sub(1, std::memory_order_acq_rel);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * @brief 担当のワーカーが塞がったまま取り残された固定タスクを肩代わりする
+         * @note parallel_for_staticの呼び出し元が自分の区間を終えた後にだけ使う.
+         *       担当がその時点でまだ取りに来ていなければ、局所性よりも待たないことを優先する.
+         */
+        bool run_stalled_pinned_task()
+        {
+            std::function<void()> task;
+            for (auto& queue : queues_)
+            {
+                if (!queue->busy.load(std::memory_order_acquire) ||
+                    queue->pinned_count.load(std::memory_order_acquire) == 0)
+                    continue;
+                std::lock_guard<std::mutex> lock(queue->mtx);
+                if (!queue->pinned.empty())
+                {
+                    task = std::move(queue->pinned.back());
+                    queue->pinned.pop_back();
+                    queue->pinned_count.fetch_sub(1, std::memory_order_acq_rel);
+                    break;
+                }
+            }
+            if (!task)
+                return false;
+            task();
+            return true;
+        }
+
+        bool run_pending_task()
+        {
+            std::function<void()> task;
+            if (queues_.empty() || !try_pop(task))
+                return false;
+            task();
+            return true;
+        }
+
+        /**
+         * @brief スレッドを割り当てるCPUの一覧をNUMAノード順に並べて返す
+         * @note 連番のワーカーが同じノードに集まるので、連続した行ブロックは同じノードで処理される.
+         */
+        static std::vector<int> cpus_by_node()
+        {
+            std::vector<int> cpus;
+#if defined(__linux__)
+            cpu_set_t allowed;
+            CPU_ZERO(&allowed);
+            if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+                return cpus;
+
+            // /sys/devices/system/node/node*/cpulist (例: "0-15,32-47")
+            for (int node = 0; ; ++node)
+            {
+                std::ifstream ifs("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+                if (!ifs)
+                    break;
+                std::string list;
+                std::getline(ifs, list);
+                std::stringstream ss(list);
+                std::string range;
+                while (std::getline(ss, range, ','))
+                {
+                    if (range.empty())
+                        continue;
+                    size_t dash = range.find('-');
+                    int first = std::stoi(range.substr(0, dash));
+                    int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                    for (int cpu = first; cpu <= last; ++cpu)
+                    {
+                        if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+                            cpus.push_back(cpu);
+                    }
+                }
+            }
+
+            // ノード情報が読めない環境では許可されたCPUを番号順に使う
+            if (cpus.empty())
+            {
+                for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+                {
+                    if (CPU_ISSET(cpu, &allowed))
+                        cpus.push_back(cpu);
+                }
+            }
+#endif
+            return cpus;
+        }
+
+        static void bind_this_thread(int cpu)
+        {
+#if defined(__linux__)
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+            (void)cpu;
+#endif
+        }
+
+        void worker_loop(size_t index, int cpu)
+        {
+            if (cpu >= 0)
+                bind_this_thread(cpu);
+            this_worker() = WorkerInfo{this, index};
+            WorkQueue& own = *queues_[index];
+            // 自分が取れるのは盗めるタスクと自分に固定されたタスクだけ.
+            // 他のワーカーに固定されたタスクでは起きない(起きても取れずに空回りする)
+            auto has_work = [this, &own] {
+                return pending_.load(std::memory_order_acquire) > 0 ||
+                       own.pinned_count.load(std::memory_order_acquire) > 0;
+            };
+            for (;;)
+            {
+                own.busy.store(true, std::memory_order_release);
+                if (run_pending_task())
+                    continue;
+                own.busy.store(false, std::memory_order_release);
+
+                std::unique_lock<std::mutex> lock(sleep_mtx_);
+                cv_.wait(lock, [this, &has_work] {
+                    return stop_.load(std::memory_order_acquire) || has_work();
+                });
+                if (stop_.load(std::memory_order_acquire) && !has_work())
+                    return;
+            }
+        }
+
+    public:
+        /**
+         * @brief Construct a new Thread Pool object
+         *
+         * @param num_threads 呼び出し元を含めた並列数. 1以下ならワーカーを作らず逐次実行する.
+         * @param bind_threads trueならワーカーをNUMAノード順に並べたCPUへ固定する(Linuxのみ).
+         *                     呼び出し元のスレッドは固定しない.
+         */
+        explicit ThreadPool(size_t num_threads = std::thread::hardware_concurrency(),
+                            bool bind_threads = false)
+            : pending_(0)
+            , next_queue_(0)
+            , stop_(false)
+        {
+            size_t n_workers = num_threads > 1 ? num_threads - 1 : 0;
+            for (size_t i = 0; i < n_workers; ++i)
+            {
+                queues_.push_back(std::make_unique<WorkQueue>());
+            }
+            std::vector<int> cpus;
+            if (bind_threads)
+                cpus = cpus_by_node();
+            for (size_t i = 0; i < n_workers; ++i)
+            {
+                // 呼び出し元が先頭のCPUにいると仮定し、ワーカーはその次から割り当てる
+                int cpu = cpus.empty() ? -1 : cpus[(i + 1) % cpus.size()];
+                workers_.emplace_back([this, i, cpu] { worker_loop(i, cpu); });
+            }
+        }
+
+        ~ThreadPool()
+        {
+            stop_.store(true, std::memory_order_release);
+            wake_up(true);
+            for (auto& worker : workers_)
+            {
+                worker.join();
+            }
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        size_t size() const
+        {
+            return workers_.size() + 1;
+        }
+
+        /**
+         * @brief タスクを1つ投入する
+         * @note ワーカーがいない場合はその場で実行する.
+         * @note ワーカーの中で返り値のfutureを待つとそのワーカーが塞がるので、待つのはプール外のスレッドで行うこと.
+         */
+        template <class Func>
+            requires std::invocable<std::decay_t<Func>&>
+        auto submit(Func&& func) -> std::future<std::invoke_result_t<std::decay_t<Func>&>>
+        {
+            using Result = std::invoke_result_t<std::decay_t<Func>&>;
+            auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Func>(func));
+            auto future = task->get_future();
+            if (workers_.empty())
+            {
+                (*task)();
+                return future;
+            }
+            push([task] { (*task)(); });
+            wake_up(false);
+            return future;
+        }
+
+        /**
+         * @brief 大きさの異なるタスクをまとめて投入する
+         * @note 大きな変換は内部でparallel_forを使うので、その分割タスクは手の空いたワーカーに盗まれる.
+         */
+        template <class Func>
+        auto submit(std::vector<Func> batch) -> std::vector<std::future<std::invoke_result_t<Func&>>>
+        {
+            std::vector<std::future<std::invoke_result_t<Func&>>> futures;
+            futures.reserve(batch.size());
+            for (auto& func : batch)
+            {
+                futures.push_back(submit(std::move(func)));
+            }
+            return futures;
+        }
+
+        /**
+         * @brief 区間[begin, end)を分割して並列に処理する
+         *
+         * @param begin
+         * @param end
+         * @param grain 1タスクあたりの最小要素数. これ以下の区間は分割しない.
+         * @param func func(first, last)の形で呼ばれる
+         */
+        template <class Func>
+        void parallel_for(size_t begin, size_t end, size_t grain, Func&& func)
+        {
+            if (end <= begin)
+                return;
+
+            size_t length = end - begin;
+            grain = std::max<size_t>(grain, 1);
+            size_t n_chunks = std::min(size(), (length + grain - 1) / grain);
+            if (n_chunks <= 1)
+            {
+                func(begin, end);
+                return;
+            }
+
+            size_t chunk = (length + n_chunks - 1) / n_chunks;
+            n_chunks = (length + chunk - 1) / chunk;
+            std::atomic<size_t> remaining(n_chunks - 1);
+            for (size_t c = 1; c < n_chunks; ++c)
+            {
+                size_t first = begin + c * chunk;
+                size_t last = std::min(end, first + chunk);
+                push([&func, &remaining, first, last] {
+                    func(first, last);
+                    remaining.fetch_sub(1, std::memory_order_release);
+                });
+            }
+            wake_up(true);
+
+            // 先頭の区間は呼び出し元が担当する
+            func(begin, std::min(end, begin + chunk));
+
+            // 残りの区間が終わるまで、他のタスクを手伝いながら待つ
+            while (remaining.load(std::memory_order_acquire) > 0)
+            {
+                if (!run_pending_task())
+                    std::this_thread::yield();
+            }
+        }
+
+        /**
+         * @brief 区間[begin, end)をsize()個に等分し、c番目の区間を常に同じスレッドで処理する
+         * @note 0番目の区間は呼び出し元、c番目(c>=1)の区間はc-1番目のワーカーが担当する.
+         *       担当のワーカーが他のタスクを実行中なら、その区間は待たせずに盗めるタスクとして積む.
+         * @note 同じ長さで呼べば同じ分割になるので、バッファのファーストタッチと後続の処理でメモリの局所性がそろう.
+         *
+         * @param begin
+         * @param end
+         * @param func func(first, last)の形で呼ばれる
+         */
+        template <class Func>
+        void parallel_for_static(size_t begin, size_t end, Func&& func)
+        {
+            if (end <= begin)
+                return;
+
+            size_t length = end - begin;
+            size_t n_chunks = std::min(size(), length);
+            if (n_chunks <= 1 || is_own_worker())
+            {
+                // ワーカーの中から呼ばれた場合は固定できないので通常の分割にまかせる
+                parallel_for(begin, end, 1, std::forward<Func>(func));
+                return;
+            }
+
+            std::atomic<size_t> remaining(n_chunks - 1);
+            for (size_t c = 1; c < n_chunks; ++c)
+            {
+                size_t first = begin + length * c / n_chunks;
+                size_t last = begin + length * (c + 1) / n_chunks;
+                push_pinned(c - 1, [&func, &remaining, first, last] {
+                    func(first, last);
+                    remaining.fetch_sub(1, std::memory_order_release);
+                });
+            }
+            wake_up(true);
+
+            func(begin, begin + length / n_chunks);
+
+            while (remaining.load(std::memory_order_acquire) > 0)
+            {
+                if (!run_pending_task() && !run_stalled_pinned_task())
+                    std::this_thread::yield();
+            }
+        }
+    };
+}
@@ -0,0 +1,314 @@
+#pragma once
+
+#include "fft_policy.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+
+namespace fft
+{
+    /**
+     * @brief 高速ウォルシュ・アダマール変換(FWHT)
+     * @note Y_k = Σ_n{(-1)^popcount(k & n) * x(n)} (アダマール順). 回転子のないFFTと同じバタフライ.
+     * @note 順変換は正規化しない(整数のまま誤差なく計算できる). H*H = N*I なので、iwhtは同じ変換の後に1/Nする.
+     * @note double, float, int32_t(他の算術型も可)に対応. 整数では値が最大N倍になるので、桁あふれは呼び出し元で避けること.
+     * @note 各レベルの内側のループは連続した要素どうしの加減算だけなので、コンパイラのベクトル化がそのまま効く.
+     *       キャッシュに載るブロック内のレベルはブロックごとにまとめて行い、残りのレベルは2段ずつ(基数4)行って
+     *       メモリの往復を減らす.
+     */
+    class WalshHadamard
+    {
+        /*ブロック内でまとめて処理する要素数*/
+        static constexpr size_t cache_block = 1 << 13;
+
+        template <class Func>
+        static void dispatch(ThreadPool* pool, size_t begin, size_t end, Func&& func, size_t grain = parallel_grain)
+        {
+            if (pool)
+                pool->parallel_for(begin, end, grain, std::forward<Func>(func));
+            else
+                func(begin, end);
+        }
+
+        /**
+         * @brief キャッシュに載る長さnの区間の全レベル
+         */
+        template <class T>
+        static void local_levels(T* data, size_t n)
+        {
+            if (n < 4)
+            {
+                if (n == 2)
+                {
+                    T a = data[0];
+                    data[0] = a + data[1];
+                    data[1] = a - data[1];
+                }
+                return;
+            }
+
+            // 最初の2レベルは4点ずつまとめる
+            for (size_t i = 0; i < n; i += 4)
+            {
+                T a0 = data[i] + data[i + 1];
+                T a1 = data[i] - data[i + 1];
+                T a2 = data[i + 2] + data[i + 3];
+                T a3 = data[i + 2] - data[i + 3];
+                data[i] = a0 + a2;
+                data[i + 1] = a1 + a3;
+                data[i + 2] = a0 - a2;
+                data[i + 3] = a1 - a3;
+            }
+            for (size_t half_size = 4; half_size < n; half_size *= 2)
+            {
+                for (size_t offset = 0; offset < n; offset += 2 * half_size)
+                {
+                    T* x = data + offset;
+                    T* y = x + half_size;
+                    for (size_t k = 0; k < half_size; ++k)
+                    {
+                        T a = x[k];
+                        T b = y[k];
+                        x[k] = a + b;
+                        y[k] = a - b;
+                    }
+                }
+            }
+        }
+
+        /**
+         * @brief half_size, 2*half_sizeの2レベルを通し番号[first, last)の区間について計算する(基数4)
+         * @note 通し番号1つで、間隔half_sizeの4要素を受け持つ.
+         */
+        template <class T>
+        static void radix4(T* data, size_t half_size, size_t first, size_t last)
+        {
+            size_t j = first / half_size;
+            size_t k = first % half_size;
+            for (size_t b = first; b < last; ++j, k = 0)
+            {
+                T* x0 = data + 4 * half_size * j;
+                T* x1 = x0 + half_size;
+                T* x2 = x1 + half_size;
+                T* x3 = x2 + half_size;
+                size_t k_end = std::min(half_size, k + (last - b));
+                b += k_end - k;
+                for (; k < k_end; ++k)
+                {
+                    T a0 = x0[k] + x1[k];
+                    T a1 = x0[k] - x1[k];
+                    T a2 = x2[k] + x3[k];
+                    T a3 = x2[k] - x3[k];
+                    x0[k] = a0 + a2;
+                    x1[k] = a1 + a3;
+                    x2[k] = a0 - a2;
+                    x3[k] = a1 - a3;
+                }
+            }
+        }
+
+        /**
+         * @brief half_sizeの1レベルを通し番号[first, last)の区間について計算する
+         */
+        template <class T>
+        static void radix2(T* data, size_t half_size, size_t first, size_t last)
+        {
+            size_t j = first / half_size;
+            size_t k = first % half_size;
+            for (size_t b = first; b < last; ++j, k = 0)
+            {
+                T* x = data + 2 * half_size * j;
+                T* y = x + half_size;
+                size_t k_end = std::min(half_size, k + (last - b));
+                b += k_end - k;
+                for (; k < k_end; ++k)
+                {
+                    T a = x[k];
+                    T c = y[k];
+                    x[k] = a + c;
+                    y[k] = a - c;
+                }
+            }
+        }
+
+        template <class T>
+        static void normalize(T* data, size_t length, size_t size, ThreadPool* pool)
+        {
+            dispatch(pool, 0, length, [&](size_t first, size_t last) {
+                if constexpr (std::is_integral_v<T>)
+                {
+                    for (size_t i = first; i < last; ++i) { data[i] /= (T)size; }
+                }
+                else
+                {
+                    const T norm = T(1) / (T)size;
+                    for (size_t i = first; i < last; ++i) { data[i] *= norm; }
+                }
+            });
+        }
+
+        static bool is_power_of_2(size_t size)
+        {
+            return size != 0 && (size & (size - 1)) == 0;
+        }
+
+    public:
+        /*並列化するときの1タスクあたりの最小要素数*/
+        static constexpr size_t parallel_grain = CooleyTurkey::parallel_grain;
+
+        /**
+         * @brief 呼び出し元のメモリ上でそのまま行うWHT(正規化しない)
+         * @note ヒープ確保は行わない.
+         *
+         * @param data 長さsizeの入出力
+         * @param size 2のべき乗
+         * @param pool
+         * @return sizeが2のべき乗でなければfalse
+         */
+        template <class T>
+        static bool wht(T* data, size_t size, ThreadPool* pool = nullptr)
+        {
+            static_assert(std::is_arithmetic_v<T>, "WalshHadamard requires an arithmetic type");
+            if (!is_power_of_2(size))
+                return false;
+
+            // 1. ブロック内のレベル. ブロックどうしは独立
+            size_t block = std::min(size, cache_block);
+            dispatch(pool, 0, size / block, [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; ++i) { local_levels(data + i * block, block); }
+            }, 1);
+
+            // 2. 残りのレベル. 2レベルずつまとめる
+            size_t half_size = block;
+            for (; 4 * half_size <= size; half_size *= 4)
+            {
+                dispatch(pool, 0, size / 4, [&](size_t first, size_t last) {
+                    radix4(data, half_size, first, last);
+                });
+            }
+            if (half_size < size)
+            {
+                dispatch(pool, 0, size / 2, [&](size_t first, size_t last) {
+                    radix2(data, half_size, first, last);
+                });
+            }
+            return true;
+        }
+
+        /**
+         * @brief 逆WHT(WHTの後に1/Nする)
+         * @note 整数ではwhtの出力に対して割り切れる.
+         */
+        template <class T>
+        static bool iwht(T* data, size_t size, ThreadPool* pool = nullptr)
+        {
+            if (!wht(data, size, pool))
+                return false;
+            normalize(data, size, size, pool);
+            return true;
+        }
+
+        /**
+         * @brief 連続して並んだcount本の長さsizeのデータをそれぞれWHTする
+         * @note 本数がスレッド数以上なら1本ずつスレッドに割り当て、少なければ1本の中で並列化する.
+         */
+        template <class T>
+        static bool wht_batch(T* data, size_t size, size_t count, ThreadPool* pool = nullptr)
+        {
+            if (!is_power_of_2(size))
+                return false;
+            if (pool && count >= pool->size())
+            {
+                size_t grain = std::max<size_t>(1, parallel_grain / size);
+                pool->parallel_for(0, count, grain, [&](size_t first, size_t last) {
+                    for (size_t i = first; i < last; ++i) { wht(data + i * size, size); }
+                });
+            }
+            else
+            {
+                for (size_t i = 0; i < count; ++i) { wht(data + i * size, size, pool); }
+            }
+            return true;
+        }
+
+        template <class T>
+        static bool iwht_batch(T* data, size_t size, size_t count, ThreadPool* pool = nullptr)
+        {
+            if (!wht_batch(data, size, count, pool))
+                return false;
+            normalize(data, size * count, size, pool);
+            return true;
+        }
+
+        /**
+         * @brief 2次元WHT(行ごと、列ごとの順)
+         * @note fft2dと同じく行の変換から行うが、列の変換は転置せずに行どうしのバタフライで行う.
+         *       列のブロックをスレッドに割り当て、各行の連続した部分を加減算するのでベクトル化が効く.
+         *
+         * @param data 行優先の[height][width]
+         * @param width 2のべき乗
+         * @param height 2のべき乗
+         */
+        template <class T>
+        static bool wht2d(T* data, size_t width, size_t height, ThreadPool* pool = nullptr)
+        {
+            if (!is_power_of_2(width) || !is_power_of_2(height))
+                return false;
+
+            // 1. 画像の行ごとに変換
+            wht_batch(data, width, height, pool);
+
+            // 2. 列ごとに変換. 列ブロック[first, last)の全レベルを1タスクで行う
+            size_t grain = std::max<size_t>(1, parallel_grain / height);
+            dispatch(pool, 0, width, [&](size_t first, size_t last) {
+                for (size_t half_size = 1; half_size < height; half_size *= 2)
+                {
+                    for (size_t offset = 0; offset < height; offset += 2 * half_size)
+                    {
+                        for (size_t r = offset; r < offset + half_size; ++r)
+                        {
+                            T* x = data + r * width;
+                            T* y = x + half_size * width;
+                            for (size_t c = first; c < last; ++c)
+                            {
+                                T a = x[c];
+                                T b = y[c];
+                                x[c] = a + b;
+                                y[c] = a - b;
+                            }
+                        }
+                    }
+                }
+            }, grain);
+            return true;
+        }
+
+        template <class T>
+        static bool iwht2d(T* data, size_t width, size_t height, ThreadPool* pool = nullptr)
+        {
+            if (!wht2d(data, width, height, pool))
+                return false;
+            normalize(data, width * height, width * height, pool);
+            return true;
+        }
+
+        /**
+         * @brief シーケンシー順(符号の変化回数の順)のインデックス
+         * @note アダマール順の添字は、シーケンシーsのグレイコードをビットリバースしたもの.
+         *       indices[s]がシーケンシーsの係数のアダマール順での位置.
+         */
+        static std::vector<size_t> sequency_indices(size_t size)
+        {
+            auto workspace = CooleyTurkey::make_workspace(size);
+            std::vector<size_t> indices(size);
+            for (size_t s = 0; s < size; ++s)
+            {
+                indices[s] = workspace.indice_map[s ^ (s >> 1)];
+            }
+            return indices;
+        }
+    };
+}